@@ -0,0 +1,1047 @@
+/*
+ * SUT benchmarks
+ * Build: gcc -O2 bench.c sut.c -lpthread [-DSUT_FAST_CONTEXT]
+ * Run:   ./bench [--json] [scenario] [iterations]
+ *
+ * Every scenario runs with fixed executor counts and prints one line of results per configuration, as
+ * key=value pairs, or with --json as one JSON object per line, for regression tracking. Only the results
+ * go to stdout, what SUT prints goes to stderr, so `./bench --json | jq` works as is. Without a scenario
+ * all of them run, in order.
+ */
+#include "sut.h"
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+long iterations;
+
+double start_ns;
+double end_ns;
+atomic_int num_of_running_tasks;
+
+/**
+ * @brief  The current time of CLOCK_MONOTONIC in nanoseconds
+ */
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief  Start the clock when the first measured task starts
+ */
+void task_started() {
+    if (atomic_fetch_add(&num_of_running_tasks, 1) == 0) {
+        start_ns = now_ns();
+    }
+}
+
+/**
+ * @brief  Stop the clock when the last measured task finishes
+ */
+void task_finished() {
+    if (atomic_fetch_sub(&num_of_running_tasks, 1) == 1) {
+        end_ns = now_ns();
+    }
+}
+
+// ------------------ Reporting ------------------
+
+bool is_json;
+FILE *results; // The original stdout, fd 1 goes to stderr so that SUT's own output stays out of it
+
+/**
+ * @brief  The number of C_EXECs of the scenarios that do not set their own
+ */
+long num_of_cexecs() { return atol(getenv("SUT_NUM_CEXEC")); }
+
+/**
+ * @brief  Start a line of results, with the scenario and the context switch
+ */
+void report_begin(const char *scenario) {
+    fprintf(results, is_json ? "{\"scenario\":\"%s\",\"backend\":\"%s\"" : "scenario=%s backend=%s",
+            scenario, sut_context_backend());
+}
+
+void report_str(const char *key, const char *value) {
+    fprintf(results, is_json ? ",\"%s\":\"%s\"" : " %s=%s", key, value);
+}
+
+void report_long(const char *key, long value) {
+    fprintf(results, is_json ? ",\"%s\":%ld" : " %s=%ld", key, value);
+}
+
+void report_double(const char *key, double value) {
+    if (is_json) {
+        fprintf(results, isfinite(value) ? ",\"%s\":%.6g" : ",\"%s\":null", key, value);
+    } else {
+        fprintf(results, value > -10 && value < 10 ? " %s=%.4f" : " %s=%.1f", key, value);
+    }
+}
+
+void report_end() {
+    fprintf(results, is_json ? "}\n" : "\n");
+    fflush(results);
+}
+
+int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief  Report the p50, p90, p99 and max of samples in nanoseconds, as microseconds
+ * @note   The samples are sorted in place. The keys are the prefix followed by p50_us and so on
+ */
+void report_percentiles(const char *prefix, double *samples, long n) {
+    const char *names[] = {"p50_us", "p90_us", "p99_us", "max_us"};
+    const long permille[] = {500, 900, 990, 1000};
+    char key[64];
+
+    qsort(samples, n, sizeof(double), compare_double);
+    for (int i = 0; i < 4; i++) {
+        long index = n * permille[i] / 1000;
+        snprintf(key, sizeof(key), "%s%s", prefix, names[i]);
+        report_double(key, n > 0 ? samples[index < n ? index : n - 1] / 1e3 : 0);
+    }
+}
+
+// ------------------ Yield ping-pong ------------------
+
+void pingpong_task() {
+    task_started();
+    for (long i = 0; i < iterations; i++) {
+        sut_yield();
+    }
+    task_finished();
+    sut_exit();
+}
+
+/**
+ * @brief  Two tasks yielding to each other on one C_EXEC
+ * @note   A round trip is two yields, each one a switch to the C_EXEC and a switch to the other task
+ */
+void bench_yield() {
+    setenv("SUT_NUM_CEXEC", "1", 1);
+
+    sut_init();
+    sut_create(pingpong_task);
+    sut_create(pingpong_task);
+    sut_shutdown();
+
+    double ns_per_yield = (end_ns - start_ns) / (2.0 * iterations);
+    report_begin("yield");
+    report_long("executors", 1);
+    report_long("iterations", iterations);
+    report_double("ns_per_yield", ns_per_yield);
+    report_double("ns_per_round_trip", 2 * ns_per_yield);
+    report_double("yields_per_s", 1e9 / ns_per_yield);
+    report_end();
+}
+
+// ------------------ Preemption latency ------------------
+
+// Each hog computes this long between its yields
+const double HOG_SLICE_NS = 10e6;
+
+double *probe_gaps;
+volatile unsigned long hog_sink;
+atomic_bool is_probe_done;
+
+void hog_task() {
+    task_started();
+    while (!atomic_load(&is_probe_done)) {
+        // Mostly in its own code, the C library is never preempted
+        double until = now_ns() + HOG_SLICE_NS;
+        while (now_ns() < until && !atomic_load(&is_probe_done)) {
+            for (int i = 0; i < 10000; i++) {
+                hog_sink = hog_sink * 6364136223846793005UL + 1442695040888963407UL;
+            }
+        }
+        sut_yield();
+    }
+    sut_exit();
+}
+
+void probe_task() {
+    // Only measure once both hogs compete for the C_EXEC
+    while (atomic_load(&num_of_running_tasks) < 2) {
+        sut_yield();
+    }
+
+    for (long i = 0; i < iterations; i++) {
+        double before = now_ns();
+        sut_yield();
+        probe_gaps[i] = now_ns() - before;
+    }
+    atomic_store(&is_probe_done, true);
+    sut_exit();
+}
+
+/**
+ * @brief  How long a yielding task waits for the C_EXEC next to two CPU-bound tasks
+ * @note   Run cooperatively, then with a 1 ms quantum. A hog only yields every HOG_SLICE_NS
+ */
+void bench_preempt() {
+    const int quanta[] = {0, 1000};
+    char num[16];
+
+    setenv("SUT_NUM_CEXEC", "1", 1);
+    probe_gaps = (double *)malloc(sizeof(double) * iterations);
+
+    for (int q = 0; q < 2; q++) {
+        sprintf(num, "%d", quanta[q]);
+        setenv("SUT_QUANTUM_US", num, 1);
+        atomic_store(&is_probe_done, false);
+        atomic_store(&num_of_running_tasks, 0);
+
+        sut_init();
+        sut_create(probe_task);
+        sut_create(hog_task);
+        sut_create(hog_task);
+        sut_shutdown();
+
+        report_begin("preempt");
+        report_long("executors", 1);
+        report_long("quantum_us", quanta[q]);
+        report_long("samples", iterations);
+        report_percentiles("", probe_gaps, iterations);
+        report_end();
+    }
+
+    free(probe_gaps);
+}
+
+// ------------------ Priority latency ------------------
+
+// Each background task computes this long between its yields
+const double BACKGROUND_SLICE_NS = 50e3;
+const int NUM_OF_BACKGROUND_TASKS = 8;
+
+double *request_created_ns;
+double *request_latencies;
+atomic_bool is_requests_done;
+
+void *background_task(void *arg) {
+    (void)arg;
+    while (!atomic_load(&is_requests_done)) {
+        double until = now_ns() + BACKGROUND_SLICE_NS;
+        while (now_ns() < until) {
+        }
+        sut_yield();
+    }
+    return NULL;
+}
+
+void *request_task(void *arg) {
+    long i = (long)arg;
+    request_latencies[i] = now_ns() - request_created_ns[i];
+    return NULL;
+}
+
+/**
+ * @brief  How long a short request waits for the C_EXEC behind saturating background tasks
+ * @note   The requests come from main() every 200 us, first as SUT_PRIO_NORMAL like the background,
+ *         then as SUT_PRIO_HIGH
+ */
+void bench_prio() {
+    const int prios[] = {SUT_PRIO_NORMAL, SUT_PRIO_HIGH};
+    const char *prio_names[] = {"normal", "high"};
+    struct timespec interval = {0, 200000};
+
+    setenv("SUT_NUM_CEXEC", "1", 1);
+    request_created_ns = (double *)malloc(sizeof(double) * iterations);
+    request_latencies = (double *)malloc(sizeof(double) * iterations);
+    sut_task_t *requests = (sut_task_t *)malloc(sizeof(sut_task_t) * iterations);
+
+    for (int p = 0; p < 2; p++) {
+        atomic_store(&is_requests_done, false);
+
+        sut_init();
+        for (int i = 0; i < NUM_OF_BACKGROUND_TASKS; i++) {
+            sut_create_prio(background_task, NULL, SUT_PRIO_NORMAL);
+        }
+        for (long i = 0; i < iterations; i++) {
+            nanosleep(&interval, NULL);
+            request_created_ns[i] = now_ns();
+            requests[i] = sut_create_prio(request_task, (void *)i, prios[p]);
+        }
+        for (long i = 0; i < iterations; i++) {
+            sut_join(requests[i]);
+        }
+        atomic_store(&is_requests_done, true);
+        sut_shutdown();
+
+        report_begin("prio");
+        report_long("executors", 1);
+        report_str("request_prio", prio_names[p]);
+        report_long("samples", iterations);
+        report_percentiles("", request_latencies, iterations);
+        report_end();
+    }
+
+    free(request_created_ns);
+    free(request_latencies);
+    free(requests);
+}
+
+// ------------------ I/O throughput ------------------
+
+const int NUM_OF_IO_FILES = 16;
+const int IO_BLOCK_SIZE = 4096;
+
+/**
+ * @brief  The path of the file of an I/O task
+ */
+void io_file_path(char *path, long i) { sprintf(path, "/tmp/sut_bench_io_%ld", i); }
+
+void *io_task(void *arg) {
+    char path[64];
+    char *buf = (char *)malloc(IO_BLOCK_SIZE);
+    memset(buf, 'a' + (long)arg % 26, IO_BLOCK_SIZE);
+    io_file_path(path, (long)arg);
+
+    task_started();
+    int fd = sut_open(path);
+    for (long i = 0; i < iterations; i++) {
+        sut_write(fd, buf, IO_BLOCK_SIZE);
+    }
+    sut_close(fd);
+
+    fd = sut_open(path);
+    for (long i = 0; i < iterations; i++) {
+        sut_read(fd, buf, IO_BLOCK_SIZE);
+    }
+    sut_close(fd);
+    task_finished();
+
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief  The I/O throughput of tasks writing then reading a file each, with 1, 2 and 4 I_EXECs
+ * @note   The files are distinct, so their I/Os spread over the I_EXECs by fd
+ */
+void bench_io() {
+    const int num_of_iexecs[] = {1, 2, 4};
+    char num[16];
+    char path[64];
+
+    for (long i = 0; i < NUM_OF_IO_FILES; i++) {
+        io_file_path(path, i);
+        close(open(path, O_RDWR | O_CREAT | O_TRUNC, 0644));
+    }
+
+    for (int n = 0; n < 3; n++) {
+        sprintf(num, "%d", num_of_iexecs[n]);
+        setenv("SUT_NUM_IEXEC", num, 1);
+        atomic_store(&num_of_running_tasks, 0);
+
+        sut_init();
+        for (long i = 0; i < NUM_OF_IO_FILES; i++) {
+            sut_create_arg(io_task, (void *)i);
+        }
+        sut_shutdown();
+
+        double num_of_ios = 2.0 * NUM_OF_IO_FILES * iterations;
+        double seconds = (end_ns - start_ns) / 1e9;
+        report_begin("io");
+        report_long("io_executors", num_of_iexecs[n]);
+        report_long("files", NUM_OF_IO_FILES);
+        report_long("block", IO_BLOCK_SIZE);
+        report_long("ios", (long)num_of_ios);
+        report_double("kiops", num_of_ios / seconds / 1e3);
+        report_double("mb_per_s", num_of_ios * IO_BLOCK_SIZE / seconds / 1e6);
+        report_end();
+    }
+
+    for (long i = 0; i < NUM_OF_IO_FILES; i++) {
+        io_file_path(path, i);
+        unlink(path);
+    }
+}
+
+// ------------------ Mutex contention ------------------
+
+const int NUM_OF_LOCK_TASKS = 16;
+const int NUM_OF_LOCK_CEXECS = 4;
+#define MAX_PROBE_SAMPLES 100000
+
+sut_mutex_t sut_lock;
+pthread_mutex_t pthread_lock = PTHREAD_MUTEX_INITIALIZER;
+bool is_sut_lock;
+volatile unsigned long locked_counter;
+double *lock_probe_gaps;
+long num_of_lock_probe_gaps;
+atomic_int num_of_lock_tasks_left;
+
+/**
+ * @brief  Spin through a few steps of an LCG, the work inside and outside the critical section
+ */
+unsigned long lock_work(unsigned long x, int steps) {
+    for (int i = 0; i < steps; i++) {
+        x = x * 6364136223846793005UL + 1442695040888963407UL;
+    }
+    return x;
+}
+
+void *lock_task(void *arg) {
+    unsigned long x = (unsigned long)arg;
+
+    task_started();
+    for (long i = 0; i < iterations; i++) {
+        if (is_sut_lock) {
+            sut_mutex_lock(sut_lock);
+        } else {
+            pthread_mutex_lock(&pthread_lock);
+        }
+        locked_counter = lock_work(locked_counter, 50);
+        if (is_sut_lock) {
+            sut_mutex_unlock(sut_lock);
+        } else {
+            pthread_mutex_unlock(&pthread_lock);
+        }
+        x = lock_work(x, 200);
+        if (i % 64 == 63) {
+            sut_yield();
+        }
+    }
+    task_finished();
+    atomic_fetch_sub(&num_of_lock_tasks_left, 1);
+
+    return (void *)x;
+}
+
+void *lock_probe_task(void *arg) {
+    (void)arg;
+    while (atomic_load(&num_of_lock_tasks_left) > 0) {
+        double before = now_ns();
+        sut_yield();
+        if (num_of_lock_probe_gaps < MAX_PROBE_SAMPLES) {
+            lock_probe_gaps[num_of_lock_probe_gaps++] = now_ns() - before;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  Tasks contending for one lock, a sut_mutex_t against a pthread_mutex_t
+ * @note   A task waiting for a pthread_mutex_t blocks its whole C_EXEC. A probe task next to them
+ *         measures how long a yield takes to come back, the lock tasks yield every 64 locks. Run
+ *         cooperatively, a preempted holder of a pthread_mutex_t could block every C_EXEC
+ */
+void bench_mutex() {
+    const char *kinds[] = {"sut", "pthread"};
+    char num_of_cexecs[16];
+
+    sprintf(num_of_cexecs, "%d", NUM_OF_LOCK_CEXECS);
+    setenv("SUT_NUM_CEXEC", num_of_cexecs, 1);
+    unsetenv("SUT_QUANTUM_US");
+    lock_probe_gaps = (double *)malloc(sizeof(double) * MAX_PROBE_SAMPLES);
+
+    for (int k = 0; k < 2; k++) {
+        is_sut_lock = k == 0;
+        num_of_lock_probe_gaps = 0;
+        atomic_store(&num_of_running_tasks, 0);
+        atomic_store(&num_of_lock_tasks_left, NUM_OF_LOCK_TASKS);
+
+        sut_init();
+        sut_lock = sut_mutex_create();
+        sut_create_arg(lock_probe_task, NULL);
+        for (long i = 0; i < NUM_OF_LOCK_TASKS; i++) {
+            sut_create_arg(lock_task, (void *)(i + 1));
+        }
+        sut_shutdown();
+        sut_mutex_destroy(sut_lock);
+
+        double ns_per_lock = (end_ns - start_ns) / ((double)NUM_OF_LOCK_TASKS * iterations);
+        report_begin("mutex");
+        report_long("executors", NUM_OF_LOCK_CEXECS);
+        report_str("lock", kinds[k]);
+        report_long("tasks", NUM_OF_LOCK_TASKS);
+        report_long("iterations", iterations);
+        report_double("ns_per_lock", ns_per_lock);
+        report_double("locks_per_s", 1e9 / ns_per_lock);
+        report_long("probe_yields", num_of_lock_probe_gaps);
+        report_percentiles("probe_", lock_probe_gaps, num_of_lock_probe_gaps);
+        report_end();
+    }
+
+    free(lock_probe_gaps);
+}
+
+// ------------------ Sleep timers ------------------
+
+// The sleeps are spread evenly over this long
+const double MAX_SLEEP_NS = 100e6;
+
+double *sleep_lateness;
+
+void *sleep_task(void *arg) {
+    long i = (long)arg;
+    unsigned long ns = (unsigned long)(MAX_SLEEP_NS * (i % 1000) / 1000);
+
+    double before = now_ns();
+    sut_sleep(ns);
+    sleep_lateness[i] = now_ns() - before - ns;
+    return NULL;
+}
+
+/**
+ * @brief  Many tasks sleeping at once, each on a timer of its C_EXEC's timer wheel
+ * @note   Reports the creation time per sleeping task, and how late the sleeps end
+ */
+void bench_sleep() {
+    sleep_lateness = (double *)malloc(sizeof(double) * iterations);
+
+    sut_init();
+    double before = now_ns();
+    for (long i = 0; i < iterations; i++) {
+        sut_create_arg(sleep_task, (void *)i);
+    }
+    double create_ns = (now_ns() - before) / iterations;
+    sut_shutdown();
+
+    report_begin("sleep");
+    report_long("executors", num_of_cexecs());
+    report_long("timers", iterations);
+    report_double("max_sleep_ms", MAX_SLEEP_NS / 1e6);
+    report_double("create_ns", create_ns);
+    report_percentiles("late_", sleep_lateness, iterations);
+    report_end();
+
+    free(sleep_lateness);
+}
+
+// ------------------ Spawn throughput ------------------
+
+// Tasks created per sut_create_batch() call
+#define SPAWN_BATCH_SIZE 256
+
+void *spawn_task(void *arg) {
+    (void)arg;
+    task_finished();
+    return NULL;
+}
+
+/**
+ * @brief  Spawn trivial tasks one by one with sut_create_arg(), then in batches with sut_create_batch()
+ * @note   Reports the creation time per task, and the time per task until the last one finished
+ */
+void bench_spawn() {
+    const char *kinds[] = {"single", "batch"};
+    sut_task_arg_f fns[SPAWN_BATCH_SIZE];
+
+    for (int i = 0; i < SPAWN_BATCH_SIZE; i++) {
+        fns[i] = spawn_task;
+    }
+
+    for (int k = 0; k < 2; k++) {
+        atomic_store(&num_of_running_tasks, (int)iterations);
+
+        sut_init();
+        start_ns = now_ns();
+        if (k == 0) {
+            for (long i = 0; i < iterations; i++) {
+                sut_create_arg(spawn_task, NULL);
+            }
+        } else {
+            for (long i = 0; i < iterations; i += SPAWN_BATCH_SIZE) {
+                long n = iterations - i < SPAWN_BATCH_SIZE ? iterations - i : SPAWN_BATCH_SIZE;
+                sut_create_batch(fns, NULL, n, NULL);
+            }
+        }
+        double create_ns = (now_ns() - start_ns) / iterations;
+        sut_shutdown();
+
+        report_begin("spawn");
+        report_long("executors", num_of_cexecs());
+        report_str("kind", kinds[k]);
+        report_long("tasks", iterations);
+        report_long("batch", k == 0 ? 1 : SPAWN_BATCH_SIZE);
+        report_double("create_ns", create_ns);
+        report_double("total_ns", (end_ns - start_ns) / iterations);
+        report_double("spawns_per_s", 1e9 / create_ns);
+        report_end();
+    }
+}
+
+// ------------------ Pinned executors ------------------
+
+#define NUM_OF_AFFINITY_PAIRS 8
+
+// Each task sums this much of its own stack every round, which stays in cache while it stays on a CPU
+#define AFFINITY_WORKING_SET (16 * 1024)
+
+sut_sem_t affinity_sems[2 * NUM_OF_AFFINITY_PAIRS];
+volatile unsigned long affinity_sink;
+
+/**
+ * @brief  One side of a pair, it takes its turn, touches its working set and hands the turn over
+ */
+void *affinity_task(void *arg) {
+    long i = (long)arg;
+    long partner = i ^ 1;
+    volatile unsigned char working_set[AFFINITY_WORKING_SET];
+    unsigned long sum = 0;
+
+    for (int j = 0; j < AFFINITY_WORKING_SET; j++) {
+        working_set[j] = (unsigned char)(i + j);
+    }
+
+    task_started();
+    for (long round = 0; round < iterations; round++) {
+        sut_sem_wait(affinity_sems[i]);
+        for (int j = 0; j < AFFINITY_WORKING_SET; j += 64) {
+            sum += working_set[j];
+        }
+        sut_sem_post(affinity_sems[partner]);
+    }
+    task_finished();
+
+    affinity_sink += sum;
+    return NULL;
+}
+
+/**
+ * @brief  Open a counter of the whole process, inherited by the executors started afterwards
+ * @retval Its fd, -1 if the counter is not available
+ */
+int open_counter(unsigned int type, unsigned long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * @brief  The value of a counter per round, -1 if it is not available
+ */
+double read_counter(int fd, long rounds) {
+    unsigned long long value;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return -1;
+    }
+    return (double)value / rounds;
+}
+
+/**
+ * @brief  Pairs of tasks passing a turn between them, with the executors floating and then pinned
+ * @note   Pinned, a task woken on another C_EXEC goes back to the one it last ran on and keeps its
+ *         working set in that CPU's cache. Reports the time, the cache misses and the CPU migrations
+ *         per round, the counters read -1 where perf events are not available
+ */
+void bench_affinity() {
+    const char *cpus[] = {"", "all"};
+
+    for (int k = 0; k < 2; k++) {
+        setenv("SUT_CPUS", cpus[k], 1);
+        atomic_store(&num_of_running_tasks, 0);
+
+        // Before the executors start, they inherit the counters
+        int misses_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        int migrations_fd = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
+
+        sut_init();
+        sut_task_t tasks[2 * NUM_OF_AFFINITY_PAIRS];
+        for (int i = 0; i < 2 * NUM_OF_AFFINITY_PAIRS; i++) {
+            affinity_sems[i] = sut_sem_create(i % 2 == 0 ? 1 : 0);
+        }
+        for (long i = 0; i < 2 * NUM_OF_AFFINITY_PAIRS; i++) {
+            tasks[i] = sut_create_stack(affinity_task, (void *)i, 2 * AFFINITY_WORKING_SET + 64 * 1024);
+        }
+        for (int i = 0; i < 2 * NUM_OF_AFFINITY_PAIRS; i++) {
+            sut_join(tasks[i]);
+        }
+
+        struct sut_stats *stats = sut_stats();
+        unsigned long steals = 0;
+        int num_of_executors = 0;
+        for (int i = 0; i < stats->num_of_executors; i++) {
+            if (!stats->executors[i].is_io) {
+                steals += stats->executors[i].steals;
+                num_of_executors++;
+            }
+        }
+        free(stats);
+        sut_shutdown();
+
+        long rounds = 2 * NUM_OF_AFFINITY_PAIRS * iterations;
+        report_begin("affinity");
+        report_str("pinned", k == 0 ? "no" : "yes");
+        report_long("executors", num_of_executors);
+        report_long("pairs", NUM_OF_AFFINITY_PAIRS);
+        report_long("rounds", rounds);
+        report_double("ns_per_round", (end_ns - start_ns) / rounds);
+        report_double("cache_misses_per_round", read_counter(misses_fd, rounds));
+        report_double("migrations_per_round", read_counter(migrations_fd, rounds));
+        report_long("steals", (long)steals);
+        report_end();
+
+        if (misses_fd >= 0) {
+            close(misses_fd);
+        }
+        if (migrations_fd >= 0) {
+            close(migrations_fd);
+        }
+        for (int i = 0; i < 2 * NUM_OF_AFFINITY_PAIRS; i++) {
+            sut_sem_destroy(affinity_sems[i]);
+        }
+    }
+}
+
+// ------------------ Ready queue contention ------------------
+
+const int CONTENTION_TASKS_PER_CEXEC = 4;
+
+// A yield of every this many is timed
+#define CONTENTION_SAMPLE_INTERVAL 16
+
+double *contention_samples;
+atomic_long num_of_contention_samples;
+
+void *contention_task(void *arg) {
+    (void)arg;
+    task_started();
+    for (long i = 0; i < iterations; i++) {
+        if (i % CONTENTION_SAMPLE_INTERVAL == 0) {
+            double before = now_ns();
+            sut_yield();
+            contention_samples[atomic_fetch_add(&num_of_contention_samples, 1)] = now_ns() - before;
+        } else {
+            sut_yield();
+        }
+    }
+    task_finished();
+    return NULL;
+}
+
+/**
+ * @brief  Tasks yielding as fast as they can on 1, 2, 4 and 8 C_EXECs
+ * @note   They are created from main(), through the shared ready_queue, and spread by stealing.
+ *         Reports the yields per second over all the tasks, and how long a yield takes to come back
+ */
+void bench_contention() {
+    const int cexecs[] = {1, 2, 4, 8};
+    char num[16];
+
+    for (int c = 0; c < 4; c++) {
+        int num_of_tasks = CONTENTION_TASKS_PER_CEXEC * cexecs[c];
+        long max_samples = num_of_tasks * (iterations / CONTENTION_SAMPLE_INTERVAL + 1);
+        contention_samples = (double *)malloc(sizeof(double) * max_samples);
+        atomic_store(&num_of_contention_samples, 0);
+        atomic_store(&num_of_running_tasks, 0);
+        sprintf(num, "%d", cexecs[c]);
+        setenv("SUT_NUM_CEXEC", num, 1);
+
+        sut_init();
+        for (int i = 0; i < num_of_tasks; i++) {
+            sut_create_arg(contention_task, NULL);
+        }
+        sut_shutdown();
+
+        double num_of_yields = (double)num_of_tasks * iterations;
+        report_begin("contention");
+        report_long("executors", cexecs[c]);
+        report_long("tasks", num_of_tasks);
+        report_long("iterations", iterations);
+        report_double("yields_per_s", num_of_yields / ((end_ns - start_ns) / 1e9));
+        report_percentiles("yield_", contention_samples, atomic_load(&num_of_contention_samples));
+        report_end();
+
+        free(contention_samples);
+    }
+}
+
+// ------------------ I/O fan-out ------------------
+
+#define FANOUT_WIDTH 64
+const char *FANOUT_FILE = "/tmp/sut_bench_fanout";
+
+int fanout_fds[FANOUT_WIDTH];
+char *fanout_bufs[FANOUT_WIDTH];
+double *fanout_latencies;
+
+void *fanout_reader(void *arg) {
+    long i = (long)arg;
+    lseek(fanout_fds[i], 0, SEEK_SET);
+    sut_read(fanout_fds[i], fanout_bufs[i], IO_BLOCK_SIZE);
+    return NULL;
+}
+
+void *fanout_coordinator(void *arg) {
+    sut_task_arg_f fns[FANOUT_WIDTH];
+    void *args[FANOUT_WIDTH];
+    sut_task_t readers[FANOUT_WIDTH];
+    (void)arg;
+
+    for (long i = 0; i < FANOUT_WIDTH; i++) {
+        fanout_fds[i] = sut_open((char *)FANOUT_FILE);
+        fanout_bufs[i] = (char *)malloc(IO_BLOCK_SIZE);
+        fns[i] = fanout_reader;
+        args[i] = (void *)i;
+    }
+
+    task_started();
+    for (long round = 0; round < iterations; round++) {
+        double before = now_ns();
+        sut_create_batch(fns, args, FANOUT_WIDTH, readers);
+        for (int i = 0; i < FANOUT_WIDTH; i++) {
+            sut_join(readers[i]);
+        }
+        fanout_latencies[round] = now_ns() - before;
+    }
+    task_finished();
+
+    for (int i = 0; i < FANOUT_WIDTH; i++) {
+        sut_close(fanout_fds[i]);
+        free(fanout_bufs[i]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief  A request fanning out to FANOUT_WIDTH reads at once and waiting for all of them
+ * @note   Every reader has its own fd, so the reads spread over the I_EXECs. Reports the reads per
+ *         second and the latency of a whole round, with 1 and 2 I_EXECs
+ */
+void bench_fanout() {
+    const int num_of_iexecs[] = {1, 2};
+    char num[16];
+    char *block = (char *)malloc(IO_BLOCK_SIZE);
+
+    // The one block every reader reads again
+    int fd = open(FANOUT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    memset(block, 'f', IO_BLOCK_SIZE);
+    if (write(fd, block, IO_BLOCK_SIZE) != IO_BLOCK_SIZE) {
+        perror("fanout");
+    }
+    close(fd);
+    free(block);
+    fanout_latencies = (double *)malloc(sizeof(double) * iterations);
+
+    for (int n = 0; n < 2; n++) {
+        sprintf(num, "%d", num_of_iexecs[n]);
+        setenv("SUT_NUM_IEXEC", num, 1);
+        atomic_store(&num_of_running_tasks, 0);
+
+        sut_init();
+        sut_create_arg(fanout_coordinator, NULL);
+        sut_shutdown();
+
+        double num_of_reads = (double)FANOUT_WIDTH * iterations;
+        report_begin("fanout");
+        report_long("executors", num_of_cexecs());
+        report_long("io_executors", num_of_iexecs[n]);
+        report_long("width", FANOUT_WIDTH);
+        report_long("rounds", iterations);
+        report_double("reads_per_s", num_of_reads / ((end_ns - start_ns) / 1e9));
+        report_percentiles("round_", fanout_latencies, iterations);
+        report_end();
+    }
+
+    free(fanout_latencies);
+    unlink(FANOUT_FILE);
+}
+
+// ------------------ CPU and I/O mix ------------------
+
+const int NUM_OF_MIX_TASKS = 8;
+
+// Each compute task works this long between its yields
+const double MIX_SLICE_NS = 20e3;
+
+atomic_int num_of_mix_io_tasks_left;
+atomic_bool is_mix_io_done;
+atomic_long num_of_mix_slices;
+double *mix_latencies;
+
+void *mix_compute_task(void *arg) {
+    unsigned long x = (unsigned long)arg;
+    while (!atomic_load(&is_mix_io_done)) {
+        double until = now_ns() + MIX_SLICE_NS;
+        while (now_ns() < until) {
+            x = x * 6364136223846793005UL + 1442695040888963407UL;
+        }
+        atomic_fetch_add(&num_of_mix_slices, 1);
+        sut_yield();
+    }
+    return (void *)x;
+}
+
+void *mix_io_task(void *arg) {
+    long i = (long)arg;
+    char path[64];
+    char *buf = (char *)malloc(IO_BLOCK_SIZE);
+    memset(buf, 'm', IO_BLOCK_SIZE);
+    io_file_path(path, i);
+
+    task_started();
+    int fd = sut_open(path);
+    for (long j = 0; j < iterations; j++) {
+        double before = now_ns();
+        sut_write(fd, buf, IO_BLOCK_SIZE);
+        mix_latencies[i * iterations + j] = now_ns() - before;
+    }
+    sut_close(fd);
+    task_finished();
+
+    // The compute tasks run until the last write
+    if (atomic_fetch_sub(&num_of_mix_io_tasks_left, 1) == 1) {
+        atomic_store(&is_mix_io_done, true);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+/**
+ * @brief  Tasks writing files next to CPU-bound tasks on the same C_EXECs
+ * @note   Reports the writes and the compute slices per second, and how long a write takes while the
+ *         C_EXECs are busy, cooperatively and then with a 1 ms quantum
+ */
+void bench_mix() {
+    const int quanta[] = {0, 1000};
+    char num[16];
+    char path[64];
+
+    mix_latencies = (double *)malloc(sizeof(double) * NUM_OF_MIX_TASKS * iterations);
+
+    for (int q = 0; q < 2; q++) {
+        for (long i = 0; i < NUM_OF_MIX_TASKS; i++) {
+            io_file_path(path, i);
+            close(open(path, O_RDWR | O_CREAT | O_TRUNC, 0644));
+        }
+        sprintf(num, "%d", quanta[q]);
+        setenv("SUT_QUANTUM_US", num, 1);
+        atomic_store(&num_of_mix_io_tasks_left, NUM_OF_MIX_TASKS);
+        atomic_store(&is_mix_io_done, false);
+        atomic_store(&num_of_mix_slices, 0);
+        atomic_store(&num_of_running_tasks, 0);
+
+        sut_init();
+        for (long i = 0; i < NUM_OF_MIX_TASKS; i++) {
+            sut_create_arg(mix_io_task, (void *)i);
+            sut_create_arg(mix_compute_task, (void *)(i + 1));
+        }
+        sut_shutdown();
+
+        double seconds = (end_ns - start_ns) / 1e9;
+        report_begin("mix");
+        report_long("executors", num_of_cexecs());
+        report_long("quantum_us", quanta[q]);
+        report_long("io_tasks", NUM_OF_MIX_TASKS);
+        report_long("compute_tasks", NUM_OF_MIX_TASKS);
+        report_double("writes_per_s", NUM_OF_MIX_TASKS * iterations / seconds);
+        report_double("slices_per_s", atomic_load(&num_of_mix_slices) / seconds);
+        report_percentiles("write_", mix_latencies, NUM_OF_MIX_TASKS * iterations);
+        report_end();
+    }
+
+    free(mix_latencies);
+    for (long i = 0; i < NUM_OF_MIX_TASKS; i++) {
+        io_file_path(path, i);
+        unlink(path);
+    }
+}
+
+// ------------------ Main ------------------
+
+typedef struct scenario {
+    const char *name;
+    void (*run)();
+    long default_iterations;
+} scenario;
+
+scenario scenarios[] = {
+    {"yield", bench_yield, 1000000},
+    {"preempt", bench_preempt, 200},
+    {"prio", bench_prio, 2000},
+    {"io", bench_io, 2000},
+    {"mutex", bench_mutex, 100000},
+    {"sleep", bench_sleep, 100000},
+    {"spawn", bench_spawn, 1000000},
+    {"affinity", bench_affinity, 20000},
+    {"contention", bench_contention, 100000},
+    {"fanout", bench_fanout, 2000},
+    {"mix", bench_mix, 2000},
+};
+
+// The settings the scenarios change, put back to the user's before each one
+const char *env_names[] = {"SUT_NUM_CEXEC", "SUT_NUM_IEXEC", "SUT_QUANTUM_US", "SUT_CPUS"};
+#define NUM_OF_ENV_NAMES 4
+
+// The C_EXECs of the scenarios that do not set their own, unless SUT_NUM_CEXEC is set
+#define NUM_OF_BENCH_CEXECS "4"
+
+int main(int argc, char *argv[]) {
+    const char *args[2] = {NULL, NULL};
+    const char *user_env[NUM_OF_ENV_NAMES];
+    int num_of_scenarios = sizeof(scenarios) / sizeof(scenarios[0]);
+    int num_of_args = 0;
+    bool found = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            is_json = true;
+        } else if (num_of_args < 2) {
+            args[num_of_args++] = argv[i];
+        }
+    }
+    const char *name = args[0];
+
+    // Keep stdout for the results before SUT prints anything, and send fd 1 to stderr
+    results = fdopen(dup(STDOUT_FILENO), "w");
+    if (results == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("bench");
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    for (int i = 0; i < NUM_OF_ENV_NAMES; i++) {
+        user_env[i] = getenv(env_names[i]) ? strdup(getenv(env_names[i])) : NULL;
+    }
+
+    for (int i = 0; i < num_of_scenarios; i++) {
+        if (name != NULL && strcmp(name, scenarios[i].name) != 0) {
+            continue;
+        }
+
+        for (int j = 0; j < NUM_OF_ENV_NAMES; j++) {
+            if (user_env[j] != NULL) {
+                setenv(env_names[j], user_env[j], 1);
+            } else {
+                unsetenv(env_names[j]);
+            }
+        }
+        setenv("SUT_NUM_CEXEC", NUM_OF_BENCH_CEXECS, 0);
+
+        found = true;
+        iterations = args[1] != NULL ? atol(args[1]) : scenarios[i].default_iterations;
+        atomic_store(&num_of_running_tasks, 0);
+        scenarios[i].run();
+    }
+
+    if (!found) {
+        fprintf(stderr, "Unknown scenario %s\n", name);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef __CONTEXT_H__
+#define __CONTEXT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The context switch used by SUT.
+ * Built with -DSUT_FAST_CONTEXT on x86-64, a switch only saves the callee-saved registers,
+ * the stack pointer and the floating point control words. Otherwise ucontext is used,
+ * whose swapcontext() also saves the signal mask with a sigprocmask() system call.
+ */
+
+#if defined(SUT_FAST_CONTEXT) && defined(__x86_64__)
+
+#define SUT_CONTEXT_BACKEND "x86-64"
+
+typedef struct sut_context {
+    void *sp; // Everything else is saved on the stack it points to
+} sut_context;
+
+/**
+ * @brief  Save the current context into from and resume to
+ * @note   Defined in assembly below
+ */
+void sut_context_switch(sut_context *from, sut_context *to);
+
+/*
+ * Stack layout of a saved context, from sp upward:
+ * mxcsr, x87 control word, r15, r14, r13, r12, rbx, rbp, return address
+ */
+__asm__(".text\n"
+        ".globl sut_context_switch\n"
+        ".type sut_context_switch,@function\n"
+        "sut_context_switch:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    subq $8, %rsp\n"
+        "    stmxcsr (%rsp)\n"
+        "    fnstcw 4(%rsp)\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq (%rsi), %rsp\n"
+        "    ldmxcsr (%rsp)\n"
+        "    fldcw 4(%rsp)\n"
+        "    addq $8, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size sut_context_switch, .-sut_context_switch\n"
+        "\n"
+        // The first switch to a new context returns here with the entry function in rbx
+        ".globl sut_context_start\n"
+        ".type sut_context_start,@function\n"
+        "sut_context_start:\n"
+        "    callq *%rbx\n"
+        "    ud2\n"
+        ".size sut_context_start, .-sut_context_start\n");
+
+void sut_context_start();
+
+/**
+ * @brief  Prepare a context that runs fn on the given stack when switched to
+ * @note   fn must never return
+ * @param  *context: The context to prepare
+ * @param  *stack: The lowest address of the stack
+ * @param  size: The size of the stack
+ * @param  fn: The entry function
+ * @retval None
+ */
+void sut_context_make(sut_context *context, char *stack, size_t size, void (*fn)()) {
+    uint64_t *sp = (uint64_t *)(((uintptr_t)(stack + size)) & ~(uintptr_t)15);
+
+    *--sp = (uint64_t)sut_context_start; // Popped by ret, sut_context_start starts 16-byte aligned
+    *--sp = 0;                           // rbp
+    *--sp = (uint64_t)fn;                // rbx
+    *--sp = 0;                           // r12
+    *--sp = 0;                           // r13
+    *--sp = 0;                           // r14
+    *--sp = 0;                           // r15
+    *--sp = 0x037F00001F80;              // Default x87 control word and mxcsr
+
+    context->sp = sp;
+}
+
+#else
+
+#include <ucontext.h>
+
+#define SUT_CONTEXT_BACKEND "ucontext"
+
+typedef struct sut_context {
+    ucontext_t uc;
+} sut_context;
+
+/**
+ * @brief  Save the current context into from and resume to
+ */
+void sut_context_switch(sut_context *from, sut_context *to) { swapcontext(&from->uc, &to->uc); }
+
+/**
+ * @brief  Prepare a context that runs fn on the given stack when switched to
+ * @note   fn must never return
+ * @param  *context: The context to prepare
+ * @param  *stack: The lowest address of the stack
+ * @param  size: The size of the stack
+ * @param  fn: The entry function
+ * @retval None
+ */
+void sut_context_make(sut_context *context, char *stack, size_t size, void (*fn)()) {
+    getcontext(&context->uc);
+    context->uc.uc_stack.ss_sp = stack;
+    context->uc.uc_stack.ss_size = size;
+    context->uc.uc_stack.ss_flags = 0;
+    context->uc.uc_link = 0;
+    makecontext(&context->uc, fn, 0);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * A log-linear histogram in the style of HdrHistogram: the values below 8 have a bucket each, and
+ * every power of two above is split into 8 buckets, so a bucket is never wider than 12.5% of its values.
+ * Only one thread records into a histogram, any thread may read it.
+ */
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram {
+    atomic_ulong count;
+    atomic_ulong sum;
+    atomic_ulong max;
+    atomic_ulong buckets[HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @brief  The bucket of a value
+ */
+int histogram_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int)value;
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (msb - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/**
+ * @brief  The lowest value of a bucket
+ */
+uint64_t histogram_bucket_low(int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+
+    int msb = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+    uint64_t sub = index % HISTOGRAM_SUB_BUCKETS;
+    return (HISTOGRAM_SUB_BUCKETS + sub) << (msb - HISTOGRAM_SUB_BITS);
+}
+
+/**
+ * @brief  Add an increment to a counter only its owner thread writes
+ * @note   A relaxed load and store, no locked instruction
+ */
+void counter_add(atomic_ulong *counter, unsigned long increment) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + increment,
+                          memory_order_relaxed);
+}
+
+/**
+ * @brief  Record a value
+ * @note   Owner thread only
+ */
+void histogram_record(struct histogram *h, uint64_t value) {
+    counter_add(&h->buckets[histogram_index(value)], 1);
+    counter_add(&h->count, 1);
+    counter_add(&h->sum, value);
+    if (value > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, value, memory_order_relaxed);
+    }
+}
+
+#endif
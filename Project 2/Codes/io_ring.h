@@ -0,0 +1,196 @@
+#ifndef __IO_RING_H__
+#define __IO_RING_H__
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/*
+ * A minimal io_uring wrapper on the raw system calls, for a single submitting thread.
+ */
+
+typedef struct io_ring {
+    int ring_fd;
+    unsigned int sq_entries;
+    unsigned int cq_entries;
+    unsigned int sqe_tail;       // SQEs prepared, published to *sq_tail by io_ring_enter()
+    unsigned int num_to_submit;
+
+    void *ring_ptr;
+    size_t ring_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+} io_ring;
+
+/**
+ * @brief  Set up an io_uring and map its rings
+ * @note   Fails on kernels without IORING_FEAT_RW_CUR_POS, reads and writes rely on the file position
+ * @param  *ring: The io_ring to set up
+ * @param  entries: The number of SQEs
+ * @retval Whether io_uring is usable
+ */
+bool io_ring_init(io_ring *ring, unsigned int entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(io_ring));
+
+    ring->ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->ring_fd < 0) {
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_RW_CUR_POS)) {
+        close(ring->ring_fd);
+        return false;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_ptr = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr == MAP_FAILED) {
+        close(ring->ring_fd);
+        return false;
+    }
+
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(ring->ring_ptr, ring->ring_size);
+        close(ring->ring_fd);
+        return false;
+    }
+
+    char *ptr = (char *)ring->ring_ptr;
+    ring->sq_entries = params.sq_entries;
+    ring->cq_entries = params.cq_entries;
+    ring->sq_head = (unsigned int *)(ptr + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(ptr + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(ptr + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(ptr + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(ptr + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(ptr + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(ptr + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(ptr + params.cq_off.cqes);
+    ring->sqe_tail = *ring->sq_tail;
+
+    return true;
+}
+
+void io_ring_destroy(io_ring *ring) {
+    munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+    munmap(ring->ring_ptr, ring->ring_size);
+    close(ring->ring_fd);
+}
+
+/**
+ * @brief  Register buffers, a READ_FIXED or WRITE_FIXED SQE then refers to one by its index
+ * @note   Their pages are pinned once here instead of at every I/O. io_ring_destroy() drops them
+ * @param  *ring: The io_ring
+ * @param  *iovecs: The buffers
+ * @param  num: The number of buffers
+ * @retval Whether they were registered
+ */
+bool io_ring_register_buffers(io_ring *ring, struct iovec *iovecs, unsigned int num) {
+    return syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_BUFFERS, iovecs, num) == 0;
+}
+
+/**
+ * @brief  The number of SQEs io_ring_get_sqe() can still hand out
+ */
+unsigned int io_ring_sq_space(io_ring *ring) {
+    return ring->sq_entries - (ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * @brief  Get a free SQE, cleared
+ * @note
+ * @param  *ring: The io_ring
+ * @retval The SQE, NULL if the submission queue is full
+ */
+struct io_uring_sqe *io_ring_get_sqe(io_ring *ring) {
+    unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->sq_entries) {
+        return NULL;
+    }
+
+    unsigned int index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    ring->num_to_submit++;
+
+    return sqe;
+}
+
+/**
+ * @brief  Submit the prepared SQEs and optionally wait for completions
+ * @note   Only the SQEs the kernel took are counted as submitted, the others stay in the ring and go
+ *         with the next call. Retried on EINTR and EAGAIN. On EBUSY the completion queue is full,
+ *         the caller has to reap before they can go. Any other error is reported on stderr
+ * @param  *ring: The io_ring
+ * @param  min_complete: The number of completions to wait for, 0 to return at once
+ * @retval The number of SQEs submitted, -1 with errno on failure
+ */
+int io_ring_enter(io_ring *ring, unsigned int min_complete) {
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    if (ring->num_to_submit == 0 && min_complete == 0) {
+        return 0;
+    }
+
+    while (true) {
+        int submitted = syscall(__NR_io_uring_enter, ring->ring_fd, ring->num_to_submit, min_complete,
+                                min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (submitted >= 0) {
+            ring->num_to_submit -= (unsigned int)submitted < ring->num_to_submit ? (unsigned int)submitted
+                                                                                  : ring->num_to_submit;
+            return submitted;
+        }
+        if (errno == EINTR || errno == EAGAIN) {
+            continue;
+        }
+        if (errno != EBUSY) {
+            perror("SUT io_uring_enter");
+        }
+        return -1;
+    }
+}
+
+/**
+ * @brief  Take the next completion
+ * @note
+ * @param  *ring: The io_ring
+ * @param  *cqe: Where the completion is copied
+ * @retval Whether there was a completion
+ */
+bool io_ring_pop_cqe(io_ring *ring, struct io_uring_cqe *cqe) {
+    unsigned int head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef COMP310_A2_Q
 #define COMP310_A2_Q
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/queue.h>
@@ -44,6 +47,10 @@ void queue_insert_tail(struct queue *q, struct queue_entry *e) {
     STAILQ_INSERT_TAIL(q, e, entries);
 }
 
+void queue_concat(struct queue *q1, struct queue *q2) {
+    STAILQ_CONCAT(q1, q2);
+}
+
 struct queue_entry *queue_peek_front(struct queue *q) {
     return STAILQ_FIRST(q);
 }
@@ -56,4 +63,148 @@ struct queue_entry *queue_pop_head(struct queue *q) {
     return elem;
 }
 
+/*
+ * A bounded lock-free multi-producer multi-consumer ring of queue_entry
+ * (Dmitry Vyukov's bounded MPMC queue). The entries are the same intrusive
+ * queue_entry as above, so nothing is allocated per insertion.
+ */
+
+struct mpmc_cell {
+    atomic_size_t sequence;
+    struct queue_entry *entry;
+};
+
+struct mpmc_queue {
+    struct mpmc_cell *cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+};
+
+/* The capacity is rounded up to a power of two */
+void mpmc_queue_init(struct mpmc_queue *q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    q->cells = (struct mpmc_cell*) malloc(size * sizeof(struct mpmc_cell));
+    if(!q->cells) {
+        queue_error();
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].sequence, i);
+    }
+    q->mask = size - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+}
+
+void mpmc_queue_destroy(struct mpmc_queue *q) {
+    free(q->cells);
+}
+
+/* Returns false when the ring is full */
+bool mpmc_queue_insert_tail(struct mpmc_queue *q, struct queue_entry *e) {
+    struct mpmc_cell *cell;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    while (true) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->entry = e;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+/* Inserts up to n entries in consecutive cells claimed together, returns how many went in */
+size_t mpmc_queue_insert_tail_batch(struct mpmc_queue *q, struct queue_entry **entries, size_t n) {
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    size_t count;
+
+    while (true) {
+        size_t seq = atomic_load_explicit(&q->cells[pos & q->mask].sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif < 0) {
+            return 0;
+        } else if (dif > 0) {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+            continue;
+        }
+
+        /* Only a producer moving enqueue_pos past them could take the free cells found here */
+        count = 1;
+        while (count < n && count <= q->mask &&
+               atomic_load_explicit(&q->cells[(pos + count) & q->mask].sequence, memory_order_acquire) ==
+                   pos + count) {
+            count++;
+        }
+        if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + count,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct mpmc_cell *cell = &q->cells[(pos + i) & q->mask];
+        cell->entry = entries[i];
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+    }
+    return count;
+}
+
+/* Returns NULL when the ring is empty, or its head is claimed but not written yet */
+struct queue_entry *mpmc_queue_pop_head(struct mpmc_queue *q) {
+    struct mpmc_cell *cell;
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    while (true) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    struct queue_entry *e = cell->entry;
+    atomic_store_explicit(&cell->sequence, pos + q->mask + 1, memory_order_release);
+    return e;
+}
+
+/* A snapshot, it may be stale by the time it is used */
+size_t mpmc_queue_size(struct mpmc_queue *q) {
+    size_t dequeue_pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    size_t enqueue_pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+bool mpmc_queue_is_empty(struct mpmc_queue *q) {
+    return atomic_load_explicit(&q->dequeue_pos, memory_order_acquire) ==
+           atomic_load_explicit(&q->enqueue_pos, memory_order_acquire);
+}
+
 #endif
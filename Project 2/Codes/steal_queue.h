@@ -0,0 +1,120 @@
+#ifndef __STEAL_QUEUE_H__
+#define __STEAL_QUEUE_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * A FIFO work-stealing queue, the push and the steal of a Chase-Lev deque (Chase & Lev, SPAA'05; C11
+ * orderings from Le et al., PPoPP'13) without its pop at the bottom. Only the owner may push at the
+ * bottom, and every thread, the owner too, takes from the top with a CAS on every take. The owner
+ * gives up the LIFO fast path so that a task it pushes back goes behind those already waiting.
+ */
+
+#define STEAL_QUEUE_INITIAL_SIZE 64
+
+struct steal_queue_array {
+    int64_t size;
+    struct steal_queue_array *prev; // Arrays replaced by a grow, a thief may still be reading them
+    _Atomic(void *) buffer[];
+};
+
+struct steal_queue {
+    _Alignas(64) atomic_int_fast64_t top;
+    _Alignas(64) atomic_int_fast64_t bottom;
+    _Atomic(struct steal_queue_array *) array;
+};
+
+struct steal_queue_array *steal_queue_array_new(int64_t size) {
+    struct steal_queue_array *a =
+        (struct steal_queue_array *)malloc(sizeof(struct steal_queue_array) + size * sizeof(_Atomic(void *)));
+    if (!a) {
+        fprintf(stderr, "Fatal error in steal_queue operations\n");
+        exit(1);
+    }
+    a->size = size;
+    a->prev = NULL;
+    return a;
+}
+
+void steal_queue_init(struct steal_queue *q) {
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    atomic_init(&q->array, steal_queue_array_new(STEAL_QUEUE_INITIAL_SIZE));
+}
+
+void steal_queue_destroy(struct steal_queue *q) {
+    struct steal_queue_array *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+    while (a) {
+        struct steal_queue_array *prev = a->prev;
+        free(a);
+        a = prev;
+    }
+}
+
+/**
+ * @brief  Double the array of the queue, copying over the live range [top, bottom)
+ * @note   Owner only. The old array is kept until steal_queue_destroy()
+ */
+struct steal_queue_array *steal_queue_grow(struct steal_queue *q, struct steal_queue_array *a, int64_t top, int64_t bottom) {
+    struct steal_queue_array *grown = steal_queue_array_new(a->size * 2);
+    for (int64_t i = top; i < bottom; i++) {
+        void *x = atomic_load_explicit(&a->buffer[i % a->size], memory_order_relaxed);
+        atomic_store_explicit(&grown->buffer[i % grown->size], x, memory_order_relaxed);
+    }
+    grown->prev = a;
+    atomic_store_explicit(&q->array, grown, memory_order_release);
+    return grown;
+}
+
+/**
+ * @brief  Push an element at the bottom of the queue
+ * @note   Owner only
+ */
+void steal_queue_push(struct steal_queue *q, void *x) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    struct steal_queue_array *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+
+    if (b - t > a->size - 1) {
+        a = steal_queue_grow(q, a, t, b);
+    }
+    atomic_store_explicit(&a->buffer[b % a->size], x, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief  Take the element at the top of the queue
+ * @note   Any thread. Returns NULL when empty or when another thread won the race for the element
+ */
+void *steal_queue_take(struct steal_queue *q) {
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+
+    if (t >= b) {
+        return NULL;
+    }
+
+    struct steal_queue_array *a = atomic_load_explicit(&q->array, memory_order_acquire);
+    void *x = atomic_load_explicit(&a->buffer[t % a->size], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return NULL;
+    }
+    return x;
+}
+
+/**
+ * @brief  A snapshot of the number of elements in the queue
+ */
+int64_t steal_queue_size(struct steal_queue *q) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    return b > t ? b - t : 0;
+}
+
+#endif
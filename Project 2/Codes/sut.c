@@ -1,531 +1,4071 @@
+#define _GNU_SOURCE // For REG_RIP and SIGEV_THREAD_ID
+
 #include "sut.h"
+#include "context.h"
+#include "steal_queue.h"
+#include "histogram.h"
+#include "io_ring.h"
 #include "queue.h"
+#include "timer_wheel.h"
+#include "trace.h"
 
+#include <dirent.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <time.h>
 #include <ucontext.h>
 #include <unistd.h>
 
 // !!!!!! The files are set to READ AND WRITE MODE !!!!!!
 
-// !!!!!! 1 for Part A and 2 for Part B !!!!!!
-const int num_of_CEXEC = 1;
+// !!!!!! Number of C_EXECs, one per online core unless SUT_NUM_CEXEC is set !!!!!!
+int num_of_CEXEC;
+
+// Number of I_EXECs, 1 unless SUT_NUM_IEXEC is set
+int num_of_IEXEC;
+
+// A C_EXEC checks the shared ready_queue before its own local_queue every this many dispatches
+const unsigned int READY_QUEUE_CHECK_INTERVAL = 61;
+
+// A C_EXEC looks at the lower priorities first every this many dispatches, so they never starve
+const unsigned int AGING_INTERVAL = 16;
+
+// A C_EXEC runs at most this many tasks in a row from its lifo_slot before the local_queues get a turn
+const unsigned int LIFO_SLOT_LIMIT = 8;
+
+// How long an idle C_EXEC leaves a task in the lifo_slot of a busy one, which may be about to run it
+const uint64_t LIFO_SLOT_STEAL_DELAY_NS = 5000;
+
+// The most completions an I_EXEC makes ready in one batch
+#define IO_READY_BATCH 64
+
+// A tick of the timer wheels is 2^TIMER_TICK_BITS ns, about 65 us, a sleep ends on the first one after it
+#define TIMER_TICK_BITS 16
+
+// The number of SQEs of each I_EXEC's io_uring, which bounds the I/Os in flight
+const unsigned int IO_RING_ENTRIES = 256;
+
+// The default capacity of the lock-free rings of the ready_queue and the wait_queue, SUT_QUEUE_CAPACITY
+// overrides it
+const size_t SHARED_QUEUE_CAPACITY = 4096;
+
+// The capacity of the rings of the shared_queues, from sut_config
+size_t shared_queue_capacity;
+
+// How an idle executor waits, SUT_IDLE_PARK or SUT_IDLE_SPIN, and how long SUT_IDLE_SPIN polls first
+int idle_policy;
+long idle_spin_us;
+
+// Whether the I_EXECs try io_uring, SUT_IO_URING=0 turns it off
+bool is_io_uring_enabled;
+
+// The default number of events each executor keeps for the trace, SUT_TRACE_EVENTS overrides it
+const size_t TRACE_EVENTS = 65536;
+
+// Where sut_shutdown() writes the Chrome trace, from SUT_TRACE. NULL when not tracing
+char *trace_path;
+uint64_t trace_start_tsc; // trace_clock() and clock_ns() at sut_init_ex(), to convert the timestamps
+uint64_t trace_start_ns;
+
+// Whether the histograms are recorded, from SUT_STATS. Each record costs a clock read
+bool is_stats_enabled;
+
+// The time slice of a task in microseconds, from SUT_QUANTUM_US. 0 keeps the scheduling cooperative
+long preempt_quantum_us;
+
+// The CPUs the executors are pinned to in turn, from SUT_CPUS. Without it they are not pinned
+int *executor_cpus;
+int num_of_executor_cpus;
+
+// The number of NUMA nodes, at most 64. The task pool keeps the stacks of every node apart
+int num_of_nodes;
+
+/**
+ * @brief  What the executor has to do with the task it just switched out of
+ * @note   The task cannot publish itself, another executor could resume it before its context is saved
+ */
+typedef enum pending_kind {
+    PENDING_NONE,
+    PENDING_READY,   // The task yielded or finished an I/O, it goes back to a ready queue
+    PENDING_PREEMPT, // The task used up its time slice, it goes back to a ready queue one priority lower
+    PENDING_WAIT,    // The task asked for an I/O, its iodesc goes to the wait_queue of an I_EXEC
+    PENDING_EXIT,    // The task exited, its taskdesc goes back to the pool
+    PENDING_PARK,    // The task blocked, the executor's park_fn puts it where it will be unparked from
+} pending_kind;
+
+typedef enum io_op {
+    IO_OPEN,
+    IO_READ,
+    IO_WRITE,
+    IO_CLOSE,
+} io_op;
+
+/**
+ * @brief  An I/O handed to the I_EXEC
+ * @note   It lives on the stack of the task, which stays parked until the I/O completes. An
+ *         asynchronous one is allocated instead, and freed by sut_await()
+ */
+typedef struct iodesc {
+    io_op op;
+    int fd;
+    char *path;
+    int open_flags;          // With IO_OPEN, added to O_RDWR
+    char *buf;
+    int size;
+    uint64_t timeout_ns;     // A read or write fails with -ETIME if not done by then, 0 for no limit
+    struct __kernel_timespec timeout; // timeout_ns for the linked IORING_OP_LINK_TIMEOUT
+    int result;              // What the system call returned, -errno on failure
+    uint64_t submit_ns;      // When the task asked for it, with is_stats_enabled
+    uint64_t trace_start;    // The same with trace_clock(), when tracing
+    struct taskdesc *task;   // The parked task, NULL for an asynchronous I/O
+    atomic_uintptr_t waiter; // Asynchronous only: 0, IO_DONE, or the taskdesc parked in sut_await()
+    struct queue_entry entry;
+} iodesc;
+
+#define IO_DONE ((uintptr_t)1)
+
+// The user_data of the IORING_OP_LINK_TIMEOUT of an I/O, its completion is ignored
+#define IO_TIMEOUT_USER_DATA ((uint64_t)1)
+
+typedef enum task_state {
+    TASK_READY,
+    TASK_RUNNING,
+    TASK_WAITING, // On an I/O
+    TASK_BLOCKED, // Parked until another task unparks it
+    TASK_EXITED,  // Back in the task pool
+} task_state;
+
+/**
+ * @brief  The task control block, with the context and the stack a task keeps for its whole life
+ * @note   Its queue_entry is embedded, so moving it between queues allocates nothing
+ */
+typedef struct taskdesc {
+    unsigned long id;
+    task_state state;
+    struct threaddesc *executor; // The executor running the task, or the last one that did
+    sut_context context;
+    char *stack;                // The lowest address of the stack in use, above its guard page
+    size_t stack_size;
+    char *pool_stack;           // The stack from the taskslab, stack is another one for a custom size
+    bool has_stack_guard;       // Whether the custom stack got a guard page
+    uint64_t ready_ns;          // When the task was last made ready, with is_stats_enabled
+    uint64_t trace_ready;       // The same with trace_clock(), when tracing
+    bool has_started;           // Whether it ran yet, for the trace
+    int base_prio;              // The priority it was created with
+    int prio;                   // The ready queues it goes to, base_prio or lower after preemptions
+    sut_task_f fn;              // NULL for a task created with an argument
+    sut_task_arg_f arg_fn;
+    void *arg;
+    void **result;              // Where arg_fn's return value goes, NULL to drop it
+    iodesc *io;                 // The I/O the task is waiting for
+    struct timer_node timer;    // In the timers of a C_EXEC while the task sleeps
+    volatile int preempt_off;   // Preemption is disabled while positive, as it is for a switched out task
+    volatile bool need_resched; // A tick came while preemption was disabled
+    int node;                   // The NUMA node of its pool stack
+    struct queue_entry entry;   // entry.data points back to the taskdesc
+    struct taskdesc *next_live; // The next task in the same bucket of the live_tasks table
+    struct queue joiners;       // The tasks parked in sut_join() on this one, under live_tasks_lock
+} taskdesc;
+
+/**
+ * @brief  Called by the executor once a task asking to park is switched out
+ * @note   It should record the task where it will be unparked from, under whatever lock guards that
+ * @param  *task: The taskdesc of the parked task
+ * @param  *arg: The argument given to park_task()
+ * @retval Whether the task stays parked, false makes it ready again at once
+ */
+typedef bool (*park_f)(struct taskdesc *task, void *arg);
+
+/**
+ * @brief  An eventcount the executors park on while they have nothing to run
+ * @note   The futex word is epoch, every notification that may have a waiter bumps it.
+ *         With an event_fd the waiter sleeps in io_uring_enter() instead, and is woken by a write to it
+ */
+typedef struct eventcount {
+    atomic_uint epoch;
+    atomic_int num_of_waiters;
+    int event_fd;
+} eventcount;
+
+// Why eventcount_wait() returned
+typedef enum wait_result {
+    WAIT_NOTIFIED,  // The epoch moved on
+    WAIT_TIMED_OUT, // The deadline passed
+    WAIT_SPURIOUS,  // Neither, e.g. a signal interrupted the futex
+} wait_result;
+
+/**
+ * @brief  A queue shared by the executors
+ * @note   Producers and consumers go through a lock-free ring. Only when it is full do entries
+ *         spill to a locked overflow list, so the order is FIFO except under overflow
+ */
+typedef struct shared_queue {
+    struct mpmc_queue ring;
+    struct queue overflow;
+    pthread_mutex_t overflow_lock;
+    atomic_int num_of_overflow;
+} shared_queue;
 
 /**
  * @brief  A built-in type which is used to record the context to the related thread id
- * @note
+ * @note   The C_EXECs take the first num_of_CEXEC slots of thread_array and the I_EXECs the rest
  * @retval None
  */
 typedef struct threaddesc {
     pid_t thread_id;
-    ucontext_t *parent_thread;
+    sut_context parent_thread;
+    int index;
+    int cpu;  // The CPU it is pinned to, -1 if it is not pinned
+    int node; // The NUMA node of that CPU, -1 if it is not pinned
+    // Tasks made ready on this C_EXEC, one FIFO per priority. The other C_EXECs steal from their top
+    struct steal_queue local_queue[SUT_NUM_PRIO];
+    // The task last woken by a task of this C_EXEC, it runs next while what they share is in cache.
+    // Holds a queue_entry, the other C_EXECs only take it when they find nothing else
+    atomic_uintptr_t lifo_slot;
+    atomic_ulong lifo_slot_ns;     // When the lifo_slot was filled, on CLOCK_MONOTONIC
+    unsigned int num_of_slot_runs; // Tasks taken from the lifo_slot in a row
+    uint64_t next_slot_steal_ns;   // When the youngest lifo_slot this C_EXEC left alone may be stolen
+    taskdesc *current_task;
+    pending_kind pending_kind;
+    park_f park_fn; // With PENDING_PARK
+    void *park_arg;
+    unsigned int num_of_dispatch;
+    unsigned int steal_seed;
+    atomic_ulong num_of_switches;        // Tasks run so far, the preemption tick and the thieves compare it
+    unsigned long preempt_seen_switches; // num_of_switches at the previous preemption tick
+    timer_t preempt_timer;                  // Sends SIGURG to this C_EXEC every quantum
+    bool has_preempt_timer;
+    atomic_ulong num_of_preemptions;
+    atomic_ulong num_of_steals;
+    struct histogram queue_wait; // From ready to running, recorded by the C_EXEC that runs the task
+    struct histogram run_slice;  // From running to switched out
+    atomic_ulong num_of_parks;
+    atomic_ulong num_of_wakeups;
+    atomic_ulong num_of_spurious_wakeups;
+    atomic_ulong num_of_timeouts;
+    struct timer_wheel timers; // The tasks sleeping on this C_EXEC
+    shared_queue inbox;        // Pinned C_EXECs only: tasks woken elsewhere that last ran on this one
+    struct trace_ring trace;   // Its scheduling events, when tracing
+
+    // Only used by the I_EXECs
+    shared_queue wait_queue;     // To store the iodescs handed to this I_EXEC
+    eventcount wait_event;       // Notified when the wait_queue gains an iodesc, the I_EXEC parks on it
+    io_ring *ring;               // NULL when the I/Os are done with blocking system calls
+    bool has_fixed_bufs;         // The buffer_pool is registered with the ring
+    struct queue io_backlog;     // iodescs taken from the wait_queue but not submitted yet
+    unsigned int num_of_inflight;
+    unsigned char *fd_busy;      // fd_busy[fd] is set while an I/O on fd is in flight
+    int fd_busy_size;
+    uint64_t event_buf;          // Target of the read armed on wait_event's eventfd
+    atomic_ulong num_of_ios;
+    struct histogram io_turnaround; // From asked to completed
 } threaddesc;
 
+/**
+ * @brief  The page-aligned buffers tasks lease for their I/Os
+ * @note   It is registered with the io_uring of every I_EXEC, which then reads and writes them
+ *         without pinning their pages again. A task asking while all are leased parks on waiters
+ */
+typedef struct buffer_pool {
+    char *bufs; // num_of_bufs buffers of buf_size bytes, one mapping
+    size_t buf_size;
+    int num_of_bufs;
+    int *free_bufs; // A stack of the indices of the free buffers
+    int num_of_free_bufs;
+    struct queue waiters;
+    pthread_mutex_t lock;
+} buffer_pool;
+
+/**
+ * @brief  The tasks parked on a channel or a lock until another task lets them go on
+ * @note   The lock is only taken to park or to wake. A task raises num_of_waiters before it checks
+ *         its condition a last time, and a waker reads it after changing that condition, so one of
+ *         the two always sees the other
+ */
+typedef struct waitlist {
+    atomic_int num_of_waiters;
+    pthread_mutex_t lock;
+    struct queue tasks;
+} waitlist;
+
+/**
+ * @brief  Whether a task has to wait on a waitlist, called with its lock held
+ */
+typedef bool (*should_wait_f)(void *arg);
+
+/**
+ * @brief  The argument of park_on_waitlist()
+ */
+typedef struct waitlist_park {
+    waitlist *list;
+    should_wait_f should_wait;
+    void *arg;
+} waitlist_park;
+
+/**
+ * @brief  A bounded channel of fixed-size elements, behind sut_chan_t
+ * @note   The elements are copied into a lock-free ring like mpmc_queue, each cell a sequence then
+ *         the element. Only a task that finds it full or empty parks, on senders or receivers
+ */
+struct sut_chan {
+    char *cells;
+    size_t cell_size;
+    size_t elem_size;
+    size_t mask;
+    _Alignas(64) atomic_size_t send_pos;
+    _Alignas(64) atomic_size_t recv_pos;
+    _Alignas(64) atomic_bool is_closed;
+    waitlist senders;   // Tasks parked while it was full
+    waitlist receivers; // Tasks parked while it was empty
+};
+
+/**
+ * @brief  A mutex that parks the waiting task, not its C_EXEC, behind sut_mutex_t
+ * @note   state is 0 unlocked, 1 locked, 2 locked and maybe waited for, like a futex-based mutex
+ */
+struct sut_mutex {
+    atomic_int state;
+    waitlist waiters;
+};
+
+/**
+ * @brief  A condition variable of tasks, behind sut_cond_t
+ */
+struct sut_cond {
+    waitlist waiters;
+};
+
+/**
+ * @brief  A counting semaphore of tasks, behind sut_sem_t
+ */
+struct sut_sem {
+    atomic_long value;
+    waitlist waiters;
+};
+
+// The default stack size of a task, SUT_STACK_SIZE overrides it
 const int THREAD_STACK_SIZE = 1024 * 64;
 
+// The task pool grows by this many taskdescs and stacks at a time
+#define TASK_SLAB_SIZE 64
+
+/**
+ * @brief  A block of taskdescs allocated together, with their stacks in one mapping
+ * @note   Every stack has a guard page below it, and its pages are only committed once touched
+ */
+typedef struct taskslab {
+    taskdesc tasks[TASK_SLAB_SIZE];
+    char *stacks;
+    size_t stacks_size;
+    struct queue_entry entry;
+} taskslab;
+
+size_t page_size;
+buffer_pool buf_pool;
+size_t task_stack_size;         // The stack size of the tasks from the pool, a multiple of page_size
+atomic_long num_of_guards_left; // Guard pages that can still be added, see map_stacks()
+
 int num_of_thread;
+atomic_ulong num_of_task_ids; // The id of the next task is this plus one
 int num_of_user_threads;
 bool is_running;
+atomic_bool is_runtime_done; // !is_running && !num_of_user_threads, set under num_of_user_thread_lock
+
+shared_queue ready_queue[SUT_NUM_PRIO]; // To store the tasks made ready outside of a C_EXEC, for CPU
+atomic_uint num_of_opens; // Spreads the sut_open() calls over the I_EXECs
+struct queue *free_task_queues; // The taskdescs of the exited tasks, ready to be reused, one list per node
+struct queue task_slab_queue; // Every taskslab allocated, freed by sut_shutdown()
+taskdesc **live_tasks;        // The tasks not exited yet, a hash table on the id chained by next_live
+unsigned long live_tasks_size;
+unsigned long num_of_live_tasks;
+struct threaddesc **thread_array; // The array to record all the existing thread description, C_EXECs first
 
-struct queue ready_queue; // To store the contexts created, for CPU
-struct queue wait_queue;  // To store the contexts created, for I/O
-struct queue entry_created_queue;
-struct threaddesc *thread_array[3]; // The array to record all the existing thread description
+eventcount ready_event; // Notified when a task becomes ready, the C_EXECs park on it
+eventcount join_event;  // Notified when a task exits, the threads outside of SUT wait on it in sut_join()
 
 pthread_mutex_t num_of_thread_lock;
-pthread_mutex_t ready_queue_lock;
-pthread_mutex_t wait_queue_lock;
-pthread_mutex_t thread_array_lock;
 pthread_mutex_t num_of_user_thread_lock;
-pthread_mutex_t entry_created_queue_lock;
+pthread_mutex_t task_pool_lock;
+pthread_mutex_t live_tasks_lock;
+
+pthread_t *CEXEC; // num_of_CEXEC threads
+pthread_t *IEXEC; // num_of_IEXEC threads
+
+struct sigaction old_preempt_action; // Restored by sut_shutdown()
 
-pthread_t *CEXEC;
-pthread_t *CEXEC_1;
-pthread_t *CEXEC_2;
-pthread_t *IEXEC;
+__thread threaddesc *current_executor; // The description of the executor of this thread, NULL for the others
+__thread taskdesc *running_task;       // The task running on this thread, NULL on the executor's own stack
 
 // ------------------ Helper Methods ------------------
-pid_t get_thread_id(void) { return syscall(SYS_gettid); }
 
 /**
- * @brief  Get the CEXEC thread it was runing in
+ * @brief  Get the description of the executor the caller runs on
+ * @note   Not inlined: a task may resume on another executor, so the thread-local address must
+ *         not be cached across a switch
+ * @retval The description, NULL if the thread is not an executor
+ */
+__attribute__((noinline)) threaddesc *get_current_executor() { return current_executor; }
+
+/**
+ * @brief  Get the task the caller runs in
+ * @note   Not inlined for the same reason. It is a single load, so a preemption cannot split it
+ * @retval The taskdesc, NULL outside of a task
+ */
+__attribute__((noinline)) taskdesc *get_running_task() { return running_task; }
+
+/**
+ * @brief  Keep the task from being preempted until the matching preempt_enable()
+ * @note   Every runtime call a task makes is wrapped in these, the executor state is not reentrant
+ * @param  *task: The running task, NULL outside of a task
+ * @retval None
+ */
+void preempt_disable(taskdesc *task) {
+    if (task != NULL) {
+        task->preempt_off++;
+    }
+}
+
+/**
+ * @brief  The current time of CLOCK_MONOTONIC in nanoseconds
+ */
+uint64_t clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief  Announce that the executor is about to park on the eventcount
+ * @note   The caller must look for work again after this, then either wait or cancel
+ * @param  *ec: The eventcount
+ * @retval The epoch to pass to eventcount_wait()
+ */
+unsigned int eventcount_prepare(eventcount *ec) {
+    atomic_fetch_add(&ec->num_of_waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load(&ec->epoch);
+}
+
+/**
+ * @brief  Give up parking after eventcount_prepare()
+ */
+void eventcount_cancel(eventcount *ec) { atomic_fetch_sub(&ec->num_of_waiters, 1); }
+
+/**
+ * @brief  Park until the eventcount is notified after eventcount_prepare()
  * @note
- * @param  thread_id: The thread id given for seaching for its parent CEXEC
- * @retval
+ * @param  *ec: The eventcount
+ * @param  epoch: The epoch returned by eventcount_prepare()
+ * @param  deadline_ns: When to stop waiting on CLOCK_MONOTONIC, UINT64_MAX to wait for a notification
+ * @retval WAIT_NOTIFIED, WAIT_TIMED_OUT or WAIT_SPURIOUS
  */
-ucontext_t *get_parent_thread(pid_t thread_id) {
+wait_result eventcount_wait(eventcount *ec, unsigned int epoch, uint64_t deadline_ns) {
+    struct timespec timeout;
+    struct timespec *timeout_ptr = NULL;
+
+    if (deadline_ns != UINT64_MAX) {
+        uint64_t now = clock_ns();
+        uint64_t left = deadline_ns > now ? deadline_ns - now : 0;
+        timeout.tv_sec = left / 1000000000;
+        timeout.tv_nsec = left % 1000000000;
+        timeout_ptr = &timeout;
+    }
+
+    long result = syscall(SYS_futex, &ec->epoch, FUTEX_WAIT_PRIVATE, epoch, timeout_ptr, NULL, 0);
+    bool is_timed_out = result < 0 && errno == ETIMEDOUT;
+    atomic_fetch_sub(&ec->num_of_waiters, 1);
+
+    if (atomic_load(&ec->epoch) != epoch) {
+        return WAIT_NOTIFIED;
+    }
+    if (is_timed_out || (deadline_ns != UINT64_MAX && clock_ns() >= deadline_ns)) {
+        return WAIT_TIMED_OUT;
+    }
+    return WAIT_SPURIOUS;
+}
 
-    pthread_mutex_lock(&thread_array_lock);
+/**
+ * @brief  Wake the executors parked on the eventcount
+ * @note   Only costs a fence and a load when nobody is parked
+ * @param  *ec: The eventcount
+ * @param  all: Wake every waiter instead of one
+ * @retval None
+ */
+void eventcount_notify(eventcount *ec, bool all) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ec->num_of_waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&ec->epoch, 1);
+        if (ec->event_fd >= 0) {
+            uint64_t one = 1;
+            write(ec->event_fd, &one, sizeof(one));
+        } else {
+            syscall(SYS_futex, &ec->epoch, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, NULL, NULL, 0);
+        }
+    }
+}
 
-    for (int i = 0; i < (num_of_CEXEC + 1); i++) {
-        if (thread_array[i]->thread_id == thread_id) {
-            pthread_mutex_unlock(&thread_array_lock);
+/**
+ * @brief  Whether the executors are done, after sut_shutdown() and the last sut_exit()
+ */
+bool should_exit() { return atomic_load_explicit(&is_runtime_done, memory_order_acquire); }
 
-            return thread_array[i]->parent_thread;
+/**
+ * @brief  Park the executor until the eventcount is notified, the deadline passes or the runtime
+ *         shuts down
+ * @note   find_task is tried once more after announcing the park, so no notification is missed. With
+ *         SUT_IDLE_SPIN the executor first polls find_task for idle_spin_us, yielding its CPU between
+ *         two polls, so work arriving soon after runs without a wakeup
+ * @param  *self: The description of the current executor
+ * @param  *ec: The eventcount to park on
+ * @param  find_task: How the executor looks for work
+ * @param  get_deadline: When to wake up anyway, asked after find_task as it may change it, NULL for never
+ * @retval The queue_entry found, NULL if the executor should look again or exit
+ */
+struct queue_entry *park_executor(threaddesc *self, eventcount *ec, struct queue_entry *(*find_task)(threaddesc *),
+                                  uint64_t (*get_deadline)(threaddesc *)) {
+    if (idle_policy == SUT_IDLE_SPIN) {
+        uint64_t until = clock_ns() + (uint64_t)idle_spin_us * 1000;
+        uint64_t deadline_ns = get_deadline != NULL ? get_deadline(self) : UINT64_MAX;
+        if (until > deadline_ns) {
+            until = deadline_ns;
         }
+        while (clock_ns() < until) {
+            sched_yield();
+            struct queue_entry *task = find_task(self);
+            if (task != NULL || should_exit()) {
+                return task;
+            }
+        }
+    }
+
+    unsigned int epoch = eventcount_prepare(ec);
+
+    struct queue_entry *task = find_task(self);
+    if (task != NULL || should_exit()) {
+        eventcount_cancel(ec);
+        return task;
+    }
+    uint64_t deadline_ns = get_deadline != NULL ? get_deadline(self) : UINT64_MAX;
+
+    uint64_t park_start = trace_path != NULL ? trace_clock() : 0;
+    atomic_fetch_add_explicit(&self->num_of_parks, 1, memory_order_relaxed);
+    switch (eventcount_wait(ec, epoch, deadline_ns)) {
+    case WAIT_NOTIFIED:
+        atomic_fetch_add_explicit(&self->num_of_wakeups, 1, memory_order_relaxed);
+        break;
+    case WAIT_TIMED_OUT:
+        atomic_fetch_add_explicit(&self->num_of_timeouts, 1, memory_order_relaxed);
+        break;
+    case WAIT_SPURIOUS:
+        atomic_fetch_add_explicit(&self->num_of_spurious_wakeups, 1, memory_order_relaxed);
+        break;
+    }
+    if (trace_path != NULL) {
+        trace_ring_record(&self->trace, TRACE_IDLE, park_start, trace_clock(), 0, 0);
     }
 
-    pthread_mutex_unlock(&thread_array_lock);
     return NULL;
 }
 
+/**
+ * @brief  Get the number of C_EXECs to start
+ * @note   SUT_NUM_CEXEC overrides the number of online cores
+ * @retval The number of C_EXECs, at least 1
+ */
+int get_num_of_CEXEC() {
+    char *configured = getenv("SUT_NUM_CEXEC");
+    long num = configured ? strtol(configured, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    return num < 1 ? 1 : (int)num;
+}
+
+/**
+ * @brief  Set up the io_uring of the I_EXEC
+ * @note   Without is_io_uring_enabled the I/Os are done with blocking system calls
+ * @retval The io_ring, NULL if io_uring is not used
+ */
+io_ring *get_io_ring() {
+    if (!is_io_uring_enabled) {
+        return NULL;
+    }
+
+    io_ring *ring = (io_ring *)malloc(sizeof(io_ring));
+    if (!io_ring_init(ring, IO_RING_ENTRIES)) {
+        free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+/**
+ * @brief  Whether the description belongs to a C_EXEC
+ */
+bool is_CEXEC(threaddesc *desc) { return desc != NULL && desc->index < num_of_CEXEC; }
+
+/**
+ * @brief  Get the number of I_EXECs to start
+ * @note   SUT_NUM_IEXEC overrides the default of 1
+ * @retval The number of I_EXECs, at least 1
+ */
+int get_num_of_IEXEC() {
+    char *configured = getenv("SUT_NUM_IEXEC");
+    long num = configured ? strtol(configured, NULL, 10) : 1;
+
+    return num < 1 ? 1 : (int)num;
+}
+
+/**
+ * @brief  Get the CPUs to pin the executors to
+ * @note   The list is like 0-3,8,10-11, or "all" for every CPU the process may run on. The CPUs the
+ *         process may not run on are left out. The C_EXECs and then the I_EXECs take them in turn,
+ *         wrapping around
+ * @param  *configured: The list, from SUT_CPUS or sut_config, NULL not to pin the executors
+ * @param  **cpus: Set to the CPUs, NULL if the executors are not pinned
+ * @retval The number of CPUs, 0 if the executors are not pinned
+ */
+int get_executor_cpus(const char *configured, int **cpus) {
+    cpu_set_t allowed, set;
+    CPU_ZERO(&set);
+    *cpus = NULL;
+
+    if (configured == NULL || configured[0] == '\0' || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return 0;
+    }
+
+    if (strcmp(configured, "all") == 0) {
+        set = allowed;
+    } else {
+        const char *next = configured;
+        while (*next != '\0') {
+            char *end;
+            long first = strtol(next, &end, 10);
+            long last = first;
+            if (end == next) {
+                break;
+            }
+            if (*end == '-') {
+                next = end + 1;
+                last = strtol(next, &end, 10);
+            }
+            for (long cpu = first; cpu >= 0 && cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                CPU_SET(cpu, &set);
+            }
+            next = *end == ',' ? end + 1 : end;
+        }
+        CPU_AND(&set, &set, &allowed);
+    }
+
+    int num = CPU_COUNT(&set);
+    if (num == 0) {
+        return 0;
+    }
+
+    *cpus = (int *)malloc(sizeof(int) * num);
+    int count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && count < num; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            (*cpus)[count++] = cpu;
+        }
+    }
+    return num;
+}
+
+/**
+ * @brief  Whether the executors are pinned to CPUs
+ */
+bool is_pinned() { return num_of_executor_cpus > 0; }
+
+/**
+ * @brief  Get the number of NUMA nodes the system may have
+ * @note   From /sys/devices/system/node/possible, 1 without it
+ * @retval The number of nodes, between 1 and 64
+ */
+int get_num_of_nodes() {
+    FILE *file = fopen("/sys/devices/system/node/possible", "r");
+    if (file == NULL) {
+        return 1;
+    }
+
+    // A list like 0-3, the last node comes last
+    int last = 0;
+    int node;
+    while (fscanf(file, "%d", &node) == 1) {
+        last = node;
+        if (fgetc(file) == EOF) {
+            break;
+        }
+    }
+    fclose(file);
+
+    return last < 0 ? 1 : (last >= 64 ? 64 : last + 1);
+}
+
+/**
+ * @brief  Get the NUMA node of a CPU
+ * @note   Its sysfs directory holds a link named after the node
+ * @param  cpu: The CPU
+ * @retval The node, 0 if it is not known
+ */
+int get_cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    int node = 0;
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        if (strncmp(dirent->d_name, "node", 4) == 0 && sscanf(dirent->d_name + 4, "%d", &node) == 1) {
+            break;
+        }
+    }
+    closedir(dir);
+
+    return node >= 0 && node < num_of_nodes ? node : 0;
+}
+
+/**
+ * @brief  Get the NUMA node the caller runs on
+ * @note   A pinned executor knows its node, any other thread asks the kernel where it is now
+ * @retval The node
+ */
+int get_current_node() {
+    if (num_of_nodes == 1) {
+        return 0;
+    }
+
+    threaddesc *self = get_current_executor();
+    if (self != NULL && self->node >= 0) {
+        return self->node;
+    }
+
+    unsigned int cpu, node;
+    if (getcpu(&cpu, &node) != 0 || node >= (unsigned int)num_of_nodes) {
+        return 0;
+    }
+    return (int)node;
+}
+
+/**
+ * @brief  Wake every parked I_EXEC, so it sees that the runtime is done
+ */
+void notify_all_IEXEC() {
+    for (int i = num_of_CEXEC; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        eventcount_notify(&thread_array[i]->wait_event, true);
+    }
+}
+
 /**
  * @brief  Kill all the created threads
  * @note
  * @retval None
  */
 void kill_all_threads() {
+    pthread_mutex_lock(&num_of_user_thread_lock);
     is_running = false;
-    pthread_join(*IEXEC, NULL);
+    atomic_store_explicit(&is_runtime_done, num_of_user_threads == 0, memory_order_release);
+    pthread_mutex_unlock(&num_of_user_thread_lock);
+
+    eventcount_notify(&ready_event, true);
+    notify_all_IEXEC();
+
+    for (int i = 0; i < num_of_IEXEC; i++) {
+        pthread_join(IEXEC[i], NULL);
+    }
     free(IEXEC);
 
-    if (num_of_CEXEC == 1) {
-        pthread_join(*CEXEC, NULL);
-        free(CEXEC);
-    } else {
-        pthread_join(*CEXEC_1, NULL);
-        free(CEXEC_1);
-        pthread_join(*CEXEC_2, NULL);
-        free(CEXEC_2);
+    for (int i = 0; i < num_of_CEXEC; i++) {
+        pthread_join(CEXEC[i], NULL);
+    }
+    free(CEXEC);
+}
+
+/**
+ * @brief  Round the stack size up to whole pages, and to at least PTHREAD_STACK_MIN
+ */
+size_t round_stack_size(size_t size) {
+    if (size < (size_t)PTHREAD_STACK_MIN) {
+        size = PTHREAD_STACK_MIN;
+    }
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+/**
+ * @brief  Get the stack size of the tasks from the pool
+ * @note   SUT_STACK_SIZE overrides THREAD_STACK_SIZE, in bytes. sut_init_ex() rounds it
+ * @retval The stack size in bytes
+ */
+size_t get_task_stack_size() {
+    char *configured = getenv("SUT_STACK_SIZE");
+    long size = configured ? strtol(configured, NULL, 10) : THREAD_STACK_SIZE;
+
+    return size < 0 ? 0 : (size_t)size;
+}
+
+/**
+ * @brief  Get how many guard pages the stacks may have
+ * @note   A guard page splits the mapping of the stacks, so each one costs up to two of the
+ *         vm.max_map_count mappings of the process. They may use half of them, the rest is left
+ *         to malloc() and the others
+ * @retval The number of guard pages
+ */
+long get_num_of_guards() {
+    long max_map_count = 65530;
+
+    FILE *f = fopen("/proc/sys/vm/max_map_count", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%ld", &max_map_count) != 1) {
+            max_map_count = 65530;
+        }
+        fclose(f);
+    }
+    return max_map_count / 4;
+}
+
+// The default size and number of the buffers of the buffer_pool, SUT_BUF_SIZE and SUT_NUM_BUFS override them
+const int BUFFER_SIZE = 1024 * 64;
+const int NUM_OF_BUFFERS = 64;
+
+/**
+ * @brief  Get the size of the buffers of the buffer_pool
+ * @note   SUT_BUF_SIZE overrides BUFFER_SIZE, in bytes
+ */
+size_t get_buf_size() {
+    char *configured = getenv("SUT_BUF_SIZE");
+    long size = configured ? strtol(configured, NULL, 10) : BUFFER_SIZE;
+
+    return size < 0 ? 0 : (size_t)size;
+}
+
+/**
+ * @brief  Get the number of buffers of the buffer_pool
+ * @note   SUT_NUM_BUFS overrides NUM_OF_BUFFERS, 0 for none
+ */
+int get_num_of_bufs() {
+    char *configured = getenv("SUT_NUM_BUFS");
+    long num = configured ? strtol(configured, NULL, 10) : NUM_OF_BUFFERS;
+
+    return num < 0 ? 0 : (int)num;
+}
+
+/**
+ * @brief  Map the buffers of the buffer_pool, all free
+ * @note   The size is rounded up to whole pages, so every buffer is page-aligned
+ * @param  size: The size of a buffer in bytes
+ * @param  num: The number of buffers
+ * @retval None
+ */
+void init_buffer_pool(size_t size, int num) {
+    buf_pool.buf_size = (size < 1 ? page_size : (size + page_size - 1) / page_size * page_size);
+    buf_pool.num_of_bufs = num < 0 ? 0 : num;
+    buf_pool.bufs = NULL;
+    if (buf_pool.num_of_bufs > 0) {
+        buf_pool.bufs = (char *)mmap(NULL, buf_pool.buf_size * buf_pool.num_of_bufs, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (buf_pool.bufs == MAP_FAILED) {
+            buf_pool.bufs = NULL;
+            buf_pool.num_of_bufs = 0;
+        }
+    }
+
+    // Handed out from the lowest address
+    buf_pool.free_bufs = (int *)malloc(sizeof(int) * (buf_pool.num_of_bufs + 1));
+    for (int i = 0; i < buf_pool.num_of_bufs; i++) {
+        buf_pool.free_bufs[i] = buf_pool.num_of_bufs - 1 - i;
+    }
+    buf_pool.num_of_free_bufs = buf_pool.num_of_bufs;
+    queue_init(&buf_pool.waiters);
+    pthread_mutex_init(&buf_pool.lock, NULL);
+}
+
+void destroy_buffer_pool() {
+    if (buf_pool.bufs != NULL) {
+        munmap(buf_pool.bufs, buf_pool.buf_size * buf_pool.num_of_bufs);
+    }
+    free(buf_pool.free_bufs);
+    pthread_mutex_destroy(&buf_pool.lock);
+}
+
+/**
+ * @brief  Register the buffer_pool with an io_uring
+ * @note   Fails e.g. over RLIMIT_MEMLOCK, the I/Os on the buffers then go through plain READ and WRITE
+ * @param  *ring: The io_uring of an I_EXEC
+ * @retval Whether it was registered
+ */
+bool register_buffer_pool(io_ring *ring) {
+    if (buf_pool.num_of_bufs == 0) {
+        return false;
+    }
+
+    struct iovec *iovecs = (struct iovec *)malloc(sizeof(struct iovec) * buf_pool.num_of_bufs);
+    for (int i = 0; i < buf_pool.num_of_bufs; i++) {
+        iovecs[i].iov_base = buf_pool.bufs + i * buf_pool.buf_size;
+        iovecs[i].iov_len = buf_pool.buf_size;
+    }
+    bool is_registered = io_ring_register_buffers(ring, iovecs, buf_pool.num_of_bufs);
+    free(iovecs);
+
+    return is_registered;
+}
+
+/**
+ * @brief  The index of the pool buffer that holds a whole I/O
+ * @param  *buf: The start of the I/O
+ * @param  size: The size of the I/O
+ * @retval The index, -1 if it is not inside one buffer of the buffer_pool
+ */
+int get_pool_buf_index(char *buf, int size) {
+    uintptr_t start = (uintptr_t)buf_pool.bufs;
+    uintptr_t addr = (uintptr_t)buf;
+    if (buf_pool.bufs == NULL || addr < start || size < 0 ||
+        addr >= start + buf_pool.buf_size * buf_pool.num_of_bufs) {
+        return -1;
+    }
+
+    size_t index = (addr - start) / buf_pool.buf_size;
+    if (addr + size > start + (index + 1) * buf_pool.buf_size) {
+        return -1;
+    }
+    return (int)index;
+}
+
+/**
+ * @brief  Map stacks of the given size, each one above a PROT_NONE guard page
+ * @note   Nothing is committed until a task touches it. An overflow faults on the guard page
+ *         instead of corrupting whatever lies below. Once the guard pages run out, see
+ *         get_num_of_guards(), the stacks are still mapped but without one
+ * @param  count: The number of stacks
+ * @param  size: The size of each stack, a multiple of page_size
+ * @param  *has_guards: Set to whether the stacks got their guard pages
+ * @retval The mapping, the first stack starts one page above it
+ */
+char *map_stacks(size_t count, size_t size, bool *has_guards) {
+    char *stacks = (char *)mmap(NULL, count * (page_size + size), PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (stacks == MAP_FAILED) {
+        queue_error();
+    }
+
+    *has_guards = atomic_fetch_sub(&num_of_guards_left, count) >= (long)count;
+    if (*has_guards) {
+        for (size_t i = 0; i < count; i++) {
+            mprotect(stacks + i * (page_size + size), page_size, PROT_NONE);
+        }
+    } else {
+        atomic_fetch_add(&num_of_guards_left, count);
+    }
+    return stacks;
+}
+
+/**
+ * @brief  Add a taskslab to the task pool of a NUMA node
+ * @note   Must be called with task_pool_lock held. With more than one node the pages of its stacks
+ *         are preferably taken from that node, wherever they are first touched
+ * @param  node: The NUMA node
+ * @retval None
+ */
+void grow_task_pool(int node) {
+    taskslab *slab = (taskslab *)calloc(1, sizeof(taskslab));
+    slab->stacks_size = TASK_SLAB_SIZE * (page_size + task_stack_size);
+    bool has_guards;
+    slab->stacks = map_stacks(TASK_SLAB_SIZE, task_stack_size, &has_guards);
+    if (num_of_nodes > 1) {
+        unsigned long node_mask = 1UL << node;
+        syscall(__NR_mbind, slab->stacks, slab->stacks_size, MPOL_PREFERRED, &node_mask,
+                sizeof(node_mask) * 8, 0);
+    }
+
+    slab->entry.data = slab;
+    queue_insert_tail(&task_slab_queue, &slab->entry);
+
+    for (int i = 0; i < TASK_SLAB_SIZE; i++) {
+        taskdesc *task = &slab->tasks[i];
+        task->pool_stack = slab->stacks + i * (page_size + task_stack_size) + page_size;
+        task->stack = task->pool_stack;
+        task->stack_size = task_stack_size;
+        task->node = node;
+        task->entry.data = task;
+        queue_insert_tail(&free_task_queues[node], &task->entry);
+    }
+}
+
+/**
+ * @brief  Take a taskdesc from the task pool of the caller's NUMA node
+ * @note   A stack of another size than task_stack_size is mapped for the task alone
+ * @param  stack_size: The stack size of the task, a multiple of page_size
+ * @retval The taskdesc, with its stack
+ */
+taskdesc *alloc_task(size_t stack_size) {
+    int node = get_current_node();
+
+    pthread_mutex_lock(&task_pool_lock);
+    struct queue_entry *entry = queue_pop_head(&free_task_queues[node]);
+    if (entry == NULL) {
+        grow_task_pool(node);
+        entry = queue_pop_head(&free_task_queues[node]);
+    }
+    pthread_mutex_unlock(&task_pool_lock);
+
+    taskdesc *task = (taskdesc *)entry->data;
+    if (stack_size != task_stack_size) {
+        task->stack = map_stacks(1, stack_size, &task->has_stack_guard) + page_size;
+        task->stack_size = stack_size;
+    }
+    return task;
+}
+
+/**
+ * @brief  Take taskdescs from the task pool of the caller's NUMA node, with the stacks of the pool
+ * @note   The pool lock is taken once for all of them
+ * @param  **entries: Filled with the queue_entries of the taskdescs
+ * @param  n: The number of taskdescs
+ * @retval None
+ */
+void alloc_tasks(struct queue_entry **entries, size_t n) {
+    int node = get_current_node();
+
+    pthread_mutex_lock(&task_pool_lock);
+    for (size_t i = 0; i < n; i++) {
+        entries[i] = queue_pop_head(&free_task_queues[node]);
+        if (entries[i] == NULL) {
+            grow_task_pool(node);
+            entries[i] = queue_pop_head(&free_task_queues[node]);
+        }
+    }
+    pthread_mutex_unlock(&task_pool_lock);
+}
+
+/**
+ * @brief  Give the taskdesc of an exited task back to the task pool of the node of its stack
+ * @note   Only once the task is switched out, it cannot give back the stack it runs on
+ * @param  *task: The taskdesc
+ * @retval None
+ */
+void release_task(taskdesc *task) {
+    if (task->stack != task->pool_stack) {
+        munmap(task->stack - page_size, page_size + task->stack_size);
+        if (task->has_stack_guard) {
+            atomic_fetch_add(&num_of_guards_left, 1);
+        }
+        task->stack = task->pool_stack;
+        task->stack_size = task_stack_size;
+    }
+
+    // At the head, the most recently used stack is still in cache
+    pthread_mutex_lock(&task_pool_lock);
+    queue_insert_head(&free_task_queues[task->node], &task->entry);
+    pthread_mutex_unlock(&task_pool_lock);
+}
+
+/**
+ * @brief  The bucket of the live_tasks table for the id
+ * @note   Must be called with live_tasks_lock held
+ */
+taskdesc **live_task_bucket(unsigned long id) { return &live_tasks[id & (live_tasks_size - 1)]; }
+
+/**
+ * @brief  Find a task that has not exited yet
+ * @note   Must be called with live_tasks_lock held
+ * @param  id: The id of the task
+ * @retval The taskdesc, NULL if the task exited
+ */
+taskdesc *find_live_task(unsigned long id) {
+    taskdesc *task = *live_task_bucket(id);
+    while (task != NULL && task->id != id) {
+        task = task->next_live;
+    }
+    return task;
+}
+
+/**
+ * @brief  Double the live_tasks table and move the tasks to their new buckets
+ * @note   With live_tasks_lock held
+ */
+void grow_live_tasks() {
+    taskdesc **old_tasks = live_tasks;
+    unsigned long old_size = live_tasks_size;
+
+    live_tasks_size *= 2;
+    live_tasks = (taskdesc **)calloc(live_tasks_size, sizeof(taskdesc *));
+    for (unsigned long i = 0; i < old_size; i++) {
+        while (old_tasks[i] != NULL) {
+            taskdesc *moved = old_tasks[i];
+            old_tasks[i] = moved->next_live;
+            moved->next_live = *live_task_bucket(moved->id);
+            *live_task_bucket(moved->id) = moved;
+        }
+    }
+    free(old_tasks);
+}
+
+/**
+ * @brief  Record new tasks in the live_tasks table, so they can be joined
+ * @note   The table grows to keep about one task per bucket
+ * @param  **entries: The queue_entries of the taskdescs
+ * @param  n: The number of tasks
+ * @retval None
+ */
+void add_live_tasks(struct queue_entry **entries, size_t n) {
+    pthread_mutex_lock(&live_tasks_lock);
+
+    num_of_live_tasks += n;
+    while (num_of_live_tasks > live_tasks_size) {
+        grow_live_tasks();
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        taskdesc *task = (taskdesc *)entries[i]->data;
+        task->next_live = *live_task_bucket(task->id);
+        *live_task_bucket(task->id) = task;
+    }
+
+    pthread_mutex_unlock(&live_tasks_lock);
+}
+
+void add_live_task(taskdesc *task) {
+    struct queue_entry *entry = &task->entry;
+    add_live_tasks(&entry, 1);
+}
+
+/**
+ * @brief  Remove an exited task from the live_tasks table
+ * @note
+ * @param  *task: The taskdesc
+ * @param  *joiners: Where the tasks parked in sut_join() on it are moved to
+ * @retval None
+ */
+void remove_live_task(taskdesc *task, struct queue *joiners) {
+    pthread_mutex_lock(&live_tasks_lock);
+
+    taskdesc **link = live_task_bucket(task->id);
+    while (*link != task) {
+        link = &(*link)->next_live;
+    }
+    *link = task->next_live;
+    num_of_live_tasks--;
+
+    queue_concat(joiners, &task->joiners);
+
+    pthread_mutex_unlock(&live_tasks_lock);
+}
+
+void shared_queue_init(shared_queue *q) {
+    mpmc_queue_init(&q->ring, shared_queue_capacity);
+    queue_init(&q->overflow);
+    pthread_mutex_init(&q->overflow_lock, NULL);
+    atomic_init(&q->num_of_overflow, 0);
+}
+
+void shared_queue_destroy(shared_queue *q) {
+    mpmc_queue_destroy(&q->ring);
+    pthread_mutex_destroy(&q->overflow_lock);
+}
+
+/**
+ * @brief  Add the entry to the tail of the shared_queue
+ * @note   Lock-free unless the ring is full
+ * @param  *q: The shared_queue
+ * @param  *entry: The queue_entry
+ * @retval None
+ */
+void shared_queue_push(shared_queue *q, struct queue_entry *entry) {
+    if (mpmc_queue_insert_tail(&q->ring, entry)) {
+        return;
+    }
+
+    pthread_mutex_lock(&q->overflow_lock);
+    queue_insert_tail(&q->overflow, entry);
+    atomic_fetch_add(&q->num_of_overflow, 1);
+    pthread_mutex_unlock(&q->overflow_lock);
+}
+
+/**
+ * @brief  Push entries to the tail of the queue together
+ * @note   They take consecutive cells of the ring, claimed with one atomic operation at a time
+ * @param  *q: The shared_queue
+ * @param  **entries: The queue_entries, in order
+ * @param  n: The number of entries
+ * @retval None
+ */
+void shared_queue_push_batch(shared_queue *q, struct queue_entry **entries, size_t n) {
+    size_t num_of_pushed = 0;
+    while (num_of_pushed < n) {
+        size_t count = mpmc_queue_insert_tail_batch(&q->ring, entries + num_of_pushed, n - num_of_pushed);
+        if (count == 0) {
+            break;
+        }
+        num_of_pushed += count;
+    }
+    if (num_of_pushed == n) {
+        return;
+    }
+
+    pthread_mutex_lock(&q->overflow_lock);
+    for (size_t i = num_of_pushed; i < n; i++) {
+        queue_insert_tail(&q->overflow, entries[i]);
+    }
+    atomic_fetch_add(&q->num_of_overflow, n - num_of_pushed);
+    pthread_mutex_unlock(&q->overflow_lock);
+}
+
+/**
+ * @brief  Take the entry at the head of the shared_queue
+ * @note   The lock is only taken when the overflow list is not empty
+ * @param  *q: The shared_queue
+ * @retval The queue_entry, NULL if the queue is empty
+ */
+struct queue_entry *shared_queue_pop(shared_queue *q) {
+    struct queue_entry *entry = mpmc_queue_pop_head(&q->ring);
+
+    if (entry == NULL && atomic_load(&q->num_of_overflow) > 0) {
+        pthread_mutex_lock(&q->overflow_lock);
+        entry = queue_pop_head(&q->overflow);
+        if (entry != NULL) {
+            atomic_fetch_sub(&q->num_of_overflow, 1);
+        }
+        pthread_mutex_unlock(&q->overflow_lock);
+    }
+
+    return entry;
+}
+
+/**
+ * @brief  A snapshot of the number of entries in the shared_queue
+ */
+long shared_queue_size(shared_queue *q) {
+    return (long)mpmc_queue_size(&q->ring) + atomic_load(&q->num_of_overflow);
+}
+
+bool shared_queue_is_empty(shared_queue *q) {
+    return mpmc_queue_is_empty(&q->ring) && atomic_load(&q->num_of_overflow) == 0;
+}
+
+/**
+ * @brief  Add the task to the shared ready_queue of its priority
+ * @note
+ * @param  *task: The queue_entry of the task
+ * @retval None
+ */
+void push_ready_queue(struct queue_entry *task) {
+    shared_queue_push(&ready_queue[((taskdesc *)task->data)->prio], task);
+}
+
+/**
+ * @brief  Take the task at the head of the shared ready_queue of a priority
+ * @note
+ * @param  prio: The priority
+ * @retval The queue_entry of the task, NULL if the queue is empty
+ */
+struct queue_entry *pop_ready_queue(int prio) { return shared_queue_pop(&ready_queue[prio]); }
+
+/**
+ * @brief  Record when the task was made ready, for the stats and the trace
+ */
+void stamp_ready(taskdesc *task) {
+    if (is_stats_enabled) {
+        task->ready_ns = clock_ns();
+    }
+    if (trace_path != NULL) {
+        task->trace_ready = trace_clock();
+    }
+}
+
+/**
+ * @brief  Make the task ready from the executor it is running on
+ * @note   A C_EXEC keeps it in its own local_queue, anything else goes through the ready_queue. With
+ *         pinned executors a task that ran before goes back to the C_EXEC it last ran on, through
+ *         its inbox when made ready elsewhere, and only moves when another C_EXEC steals it
+ * @param  *self: The description of the current executor, NULL for other threads
+ * @param  *task: The queue_entry of the task
+ * @retval None
+ */
+void make_ready(threaddesc *self, struct queue_entry *task) {
+    threaddesc *home = ((taskdesc *)task->data)->executor;
+
+    stamp_ready((taskdesc *)task->data);
+
+    if (is_pinned() && home != NULL && home != self) {
+        shared_queue_push(&home->inbox, task);
+    } else if (is_CEXEC(self)) {
+        steal_queue_push(&self->local_queue[((taskdesc *)task->data)->prio], task);
+    } else {
+        push_ready_queue(task);
+    }
+
+    eventcount_notify(&ready_event, false);
+}
+
+/**
+ * @brief  Make a task woken by the running task ready, to run right after it
+ * @note   On a C_EXEC it goes to the lifo_slot, and the task it replaces to the bottom of the
+ *         local_queue. The C_EXEC takes it at its next switch, and a parked C_EXEC is woken in case
+ *         the running task goes on for long, it then steals it. A task that
+ *         belongs to another pinned C_EXEC, or one made ready outside of a C_EXEC, goes through
+ *         make_ready()
+ * @param  *self: The description of the current executor, NULL for other threads
+ * @param  *task: The queue_entry of the task
+ * @retval None
+ */
+void make_ready_next(threaddesc *self, struct queue_entry *task) {
+    threaddesc *home = ((taskdesc *)task->data)->executor;
+
+    if (!is_CEXEC(self) || (is_pinned() && home != NULL && home != self)) {
+        make_ready(self, task);
+        return;
+    }
+
+    stamp_ready((taskdesc *)task->data);
+
+    // Before the task, so a thief that sees the task also sees at least this time
+    atomic_store_explicit(&self->lifo_slot_ns, clock_ns(), memory_order_relaxed);
+    struct queue_entry *replaced = (struct queue_entry *)atomic_exchange_explicit(
+        &self->lifo_slot, (uintptr_t)task, memory_order_acq_rel);
+    if (replaced != NULL) {
+        steal_queue_push(&self->local_queue[((taskdesc *)replaced->data)->prio], replaced);
+    }
+    eventcount_notify(&ready_event, false);
+}
+
+/**
+ * @brief  stamp_ready() for many tasks, reading the clocks once
+ */
+void stamp_ready_batch(struct queue_entry **tasks, size_t n) {
+    if (is_stats_enabled) {
+        uint64_t now = clock_ns();
+        for (size_t i = 0; i < n; i++) {
+            ((taskdesc *)tasks[i]->data)->ready_ns = now;
+        }
+    }
+    if (trace_path != NULL) {
+        uint64_t now = trace_clock();
+        for (size_t i = 0; i < n; i++) {
+            ((taskdesc *)tasks[i]->data)->trace_ready = now;
+        }
+    }
+}
+
+/**
+ * @brief  Put new tasks of the same priority to the ready queues together
+ * @note   From a C_EXEC they go to its local_queue, otherwise to the ready_queue in one batch. Every
+ *         parked C_EXEC is woken, there is work for more than one
+ * @param  *self: The description of the current executor, NULL outside of SUT
+ * @param  **tasks: The queue_entries of the tasks
+ * @param  n: The number of tasks
+ * @param  prio: Their priority
+ * @retval None
+ */
+void make_ready_batch(threaddesc *self, struct queue_entry **tasks, size_t n, int prio) {
+    stamp_ready_batch(tasks, n);
+
+    if (is_CEXEC(self)) {
+        for (size_t i = 0; i < n; i++) {
+            steal_queue_push(&self->local_queue[prio], tasks[i]);
+        }
+    } else {
+        shared_queue_push_batch(&ready_queue[prio], tasks, n);
+    }
+
+    eventcount_notify(&ready_event, n > 1);
+}
+
+/**
+ * @brief  Make the tasks whose I/Os an I_EXEC completed ready together
+ * @note   Those of each priority go to its ready_queue in one batch, those that belong to a pinned
+ *         C_EXEC to its inbox, and the C_EXECs are notified once
+ * @param  **tasks: The queue_entries of the tasks, reordered
+ * @param  n: The number of tasks
+ * @retval None
+ */
+void make_ready_completed(struct queue_entry **tasks, size_t n) {
+    if (n == 0) {
+        return;
+    }
+    stamp_ready_batch(tasks, n);
+
+    // Those of pinned C_EXECs go to their inboxes, the others are packed at the front, then grouped
+    // by priority
+    size_t num_of_shared = 0;
+    for (size_t i = 0; i < n; i++) {
+        threaddesc *home = ((taskdesc *)tasks[i]->data)->executor;
+        if (is_pinned() && home != NULL) {
+            shared_queue_push(&home->inbox, tasks[i]);
+        } else {
+            tasks[num_of_shared++] = tasks[i];
+        }
+    }
+    for (int prio = 0; prio < SUT_NUM_PRIO; prio++) {
+        size_t num_of_prio = 0;
+        for (size_t i = 0; i < num_of_shared; i++) {
+            if (((taskdesc *)tasks[i]->data)->prio == prio) {
+                struct queue_entry *swapped = tasks[num_of_prio];
+                tasks[num_of_prio++] = tasks[i];
+                tasks[i] = swapped;
+            }
+        }
+        shared_queue_push_batch(&ready_queue[prio], tasks, num_of_prio);
+        tasks += num_of_prio;
+        num_of_shared -= num_of_prio;
+    }
+
+    eventcount_notify(&ready_event, n > 1);
+}
+
+/**
+ * @brief  Make a task parked by park_task() ready again
+ * @note   Any thread, once the task was recorded by its park_fn
+ * @param  *task: The taskdesc of the parked task
+ * @retval None
+ */
+void unpark_task(taskdesc *task) {
+    task->state = TASK_READY;
+    make_ready_next(get_current_executor(), &task->entry);
+}
+
+/**
+ * @brief  Give the taskdesc of an exited task back and wake the tasks joining it
+ * @note
+ * @param  *task: The taskdesc, switched out
+ * @retval None
+ */
+void finish_task(taskdesc *task) {
+    struct queue joiners;
+    queue_init(&joiners);
+    remove_live_task(task, &joiners);
+    release_task(task);
+
+    struct queue_entry *joiner = queue_pop_head(&joiners);
+    while (joiner != NULL) {
+        unpark_task((taskdesc *)joiner->data);
+        joiner = queue_pop_head(&joiners);
+    }
+
+    eventcount_notify(&join_event, true);
+}
+
+/**
+ * @brief  Hand the iodesc to the I_EXEC of its fd
+ * @note   All the I/Os on an fd go to the same I_EXEC, which keeps them in order. An open has no
+ *         fd yet, the opens are spread round-robin
+ * @param  *io: The iodesc
+ * @retval None
+ */
+void submit_io(iodesc *io) {
+    unsigned int target;
+    if (io->op == IO_OPEN) {
+        target = atomic_fetch_add_explicit(&num_of_opens, 1, memory_order_relaxed) % num_of_IEXEC;
+    } else {
+        target = (unsigned int)io->fd % num_of_IEXEC;
+    }
+    threaddesc *iexec = thread_array[num_of_CEXEC + target];
+
+    if (is_stats_enabled) {
+        io->submit_ns = clock_ns();
+    }
+    if (trace_path != NULL) {
+        io->trace_start = trace_clock();
+    }
+    shared_queue_push(&iexec->wait_queue, &io->entry);
+    eventcount_notify(&iexec->wait_event, false);
+}
+
+/**
+ * @brief  Publish the task the executor just switched out of
+ * @note
+ * @param  *self: The description of the current executor
+ * @retval None
+ */
+void publish_pending(threaddesc *self) {
+    taskdesc *task = self->current_task;
+
+    // A task giving the C_EXEC up by itself is back to its own priority, one preempted drops a level
+    if (self->pending_kind == PENDING_PREEMPT) {
+        if (task->prio < SUT_PRIO_LOW) {
+            task->prio++;
+        }
+    } else {
+        task->prio = task->base_prio;
+    }
+
+    switch (self->pending_kind) {
+    case PENDING_READY:
+    case PENDING_PREEMPT:
+        task->state = TASK_READY;
+        make_ready(self, &task->entry);
+        break;
+    case PENDING_WAIT:
+        task->state = TASK_WAITING;
+        submit_io(task->io);
+        break;
+    case PENDING_EXIT:
+        task->state = TASK_EXITED;
+        finish_task(task);
+        break;
+    case PENDING_PARK:
+        // Once park_fn recorded it, the task may be unparked by another thread at any moment
+        task->state = TASK_BLOCKED;
+        if (!self->park_fn(task, self->park_arg)) {
+            task->state = TASK_READY;
+            make_ready(self, &task->entry);
+        }
+        break;
+    case PENDING_NONE:
+        break;
+    }
+
+    self->current_task = NULL;
+    self->pending_kind = PENDING_NONE;
+}
+
+/**
+ * @brief  Take a task from the top of another C_EXEC's local_queue of a priority
+ * @note   The victims are visited from a random one so idle C_EXECs do not all hit the same queue
+ * @param  *self: The description of the current C_EXEC
+ * @param  prio: The priority
+ * @retval The queue_entry of the task, NULL if nothing could be stolen
+ */
+struct queue_entry *steal_task(threaddesc *self, int prio) {
+    if (num_of_CEXEC < 2) {
+        return NULL;
+    }
+
+    self->steal_seed = self->steal_seed * 1103515245 + 12345;
+    int start = (self->steal_seed >> 16) % num_of_CEXEC;
+
+    for (int i = 0; i < num_of_CEXEC; i++) {
+        threaddesc *victim = thread_array[(start + i) % num_of_CEXEC];
+        if (victim == self) {
+            continue;
+        }
+
+        // An empty queue is skipped without the fence of steal_queue_take()
+        if (steal_queue_size(&victim->local_queue[prio]) == 0) {
+            continue;
+        }
+
+        struct queue_entry *task = steal_queue_take(&victim->local_queue[prio]);
+        if (task != NULL) {
+            counter_add(&self->num_of_steals, 1);
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief  Move the tasks of the C_EXEC's inbox to its local_queues
+ * @note   From there they run in the order of their priorities, and can be stolen as usual
+ * @param  *self: The description of the current C_EXEC
+ * @retval None
+ */
+void drain_inbox(threaddesc *self) {
+    struct queue_entry *task = shared_queue_pop(&self->inbox);
+    while (task != NULL) {
+        steal_queue_push(&self->local_queue[((taskdesc *)task->data)->prio], task);
+        task = shared_queue_pop(&self->inbox);
+    }
+}
+
+/**
+ * @brief  Take a task from the inbox of another C_EXEC that has not drained it yet
+ * @note   Only when nothing else is left, its owner is busy with a task of its own
+ * @param  *self: The description of the current C_EXEC
+ * @retval The queue_entry of the task, NULL if all the inboxes are empty
+ */
+struct queue_entry *steal_inbox(threaddesc *self) {
+    for (int i = 1; i < num_of_CEXEC; i++) {
+        threaddesc *victim = thread_array[(self->index + i) % num_of_CEXEC];
+        if (shared_queue_is_empty(&victim->inbox)) {
+            continue;
+        }
+
+        struct queue_entry *task = shared_queue_pop(&victim->inbox);
+        if (task != NULL) {
+            counter_add(&self->num_of_steals, 1);
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief  Take the task in the C_EXEC's lifo_slot, if it may run now
+ * @note   It may not when a task of a higher priority is ready on this C_EXEC or in the ready_queue,
+ *         after LIFO_SLOT_LIMIT tasks in a row from the slot, or on the dispatches that look at the
+ *         ready_queue or the lower priorities first. It then goes to the bottom of its local_queue
+ * @param  *self: The description of the current C_EXEC
+ * @param  dispatch: The number of the dispatch
+ * @retval The queue_entry of the task, NULL if the slot is empty or the task has to wait its turn
+ */
+struct queue_entry *take_lifo_slot(threaddesc *self, unsigned int dispatch) {
+    if (atomic_load_explicit(&self->lifo_slot, memory_order_relaxed) == 0) {
+        self->num_of_slot_runs = 0;
+        return NULL;
+    }
+
+    struct queue_entry *task =
+        (struct queue_entry *)atomic_exchange_explicit(&self->lifo_slot, 0, memory_order_acq_rel);
+    if (task == NULL) {
+        // Stolen in between
+        self->num_of_slot_runs = 0;
+        return NULL;
+    }
+
+    int prio = ((taskdesc *)task->data)->prio;
+    bool may_run = self->num_of_slot_runs < LIFO_SLOT_LIMIT && dispatch % READY_QUEUE_CHECK_INTERVAL != 0 &&
+                   dispatch % AGING_INTERVAL != 0;
+    for (int higher = 0; may_run && higher < prio; higher++) {
+        may_run = steal_queue_size(&self->local_queue[higher]) == 0 && shared_queue_is_empty(&ready_queue[higher]);
+    }
+
+    if (!may_run) {
+        steal_queue_push(&self->local_queue[prio], task);
+        self->num_of_slot_runs = 0;
+        return NULL;
+    }
+
+    self->num_of_slot_runs++;
+    return task;
+}
+
+/**
+ * @brief  Take the task in the lifo_slot of another C_EXEC
+ * @note   Only when nothing else is left. The task that filled the slot is often about to give its
+ *         C_EXEC up, which then runs it, so a slot is only taken once it is LIFO_SLOT_STEAL_DELAY_NS
+ *         old. A younger one is left alone, and next_slot_steal_ns tells when to look again
+ * @param  *self: The description of the current C_EXEC
+ * @retval The queue_entry of the task, NULL if all the slots are empty or too young
+ */
+struct queue_entry *steal_lifo_slot(threaddesc *self) {
+    uint64_t now = 0;
+
+    self->next_slot_steal_ns = UINT64_MAX;
+    for (int i = 1; i < num_of_CEXEC; i++) {
+        threaddesc *victim = thread_array[(self->index + i) % num_of_CEXEC];
+        if (atomic_load_explicit(&victim->lifo_slot, memory_order_acquire) == 0) {
+            continue;
+        }
+
+        now = now != 0 ? now : clock_ns();
+        uint64_t eligible = atomic_load_explicit(&victim->lifo_slot_ns, memory_order_relaxed) +
+                            LIFO_SLOT_STEAL_DELAY_NS;
+        if (now < eligible) {
+            if (eligible < self->next_slot_steal_ns) {
+                self->next_slot_steal_ns = eligible;
+            }
+            continue;
+        }
+
+        struct queue_entry *task =
+            (struct queue_entry *)atomic_exchange_explicit(&victim->lifo_slot, 0, memory_order_acq_rel);
+        if (task != NULL) {
+            counter_add(&self->num_of_steals, 1);
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief  Find a task of one priority for a C_EXEC
+ * @note   Its own local_queue first, then the shared ready_queue, then the other C_EXECs
+ * @param  *self: The description of the current C_EXEC
+ * @param  prio: The priority
+ * @param  is_global_first: Look at the ready_queue before the local_queue
+ * @retval The queue_entry of the task, NULL if there is no task of that priority
+ */
+struct queue_entry *find_task_of_prio(threaddesc *self, int prio, bool is_global_first) {
+    struct queue_entry *task = NULL;
+
+    if (is_global_first) {
+        task = pop_ready_queue(prio);
+    }
+
+    // The owner also takes from the top, a yield has to go behind the tasks already waiting
+    if (task == NULL && steal_queue_size(&self->local_queue[prio]) > 0) {
+        task = steal_queue_take(&self->local_queue[prio]);
+    }
+    if (task == NULL) {
+        task = pop_ready_queue(prio);
+    }
+    if (task == NULL) {
+        task = steal_task(self, prio);
+    }
+
+    return task;
+}
+
+/**
+ * @brief  Find the next task for a C_EXEC
+ * @note   The highest priority with a task wins. Every AGING_INTERVAL dispatches the lowest one
+ *         does instead, and a preempted task found there gets a level back, so a busy priority
+ *         cannot starve the others
+ * @param  *self: The description of the current C_EXEC
+ * @retval The queue_entry of the task, NULL if there is no work anywhere
+ */
+struct queue_entry *find_ready_task(threaddesc *self) {
+    unsigned int dispatch = ++self->num_of_dispatch;
+
+    if (is_pinned()) {
+        drain_inbox(self);
+    }
+
+    struct queue_entry *next = take_lifo_slot(self, dispatch);
+    if (next != NULL) {
+        return next;
+    }
+
+    // Look at the ready_queue first now and then, or a busy local_queue would starve it
+    bool is_global_first = dispatch % READY_QUEUE_CHECK_INTERVAL == 0;
+
+    if (dispatch % AGING_INTERVAL == 0) {
+        for (int prio = SUT_NUM_PRIO - 1; prio >= 0; prio--) {
+            struct queue_entry *task = find_task_of_prio(self, prio, is_global_first);
+            if (task != NULL) {
+                taskdesc *aged = (taskdesc *)task->data;
+                if (aged->prio > aged->base_prio) {
+                    aged->prio--;
+                }
+                return task;
+            }
+        }
+    } else {
+        for (int prio = 0; prio < SUT_NUM_PRIO; prio++) {
+            struct queue_entry *task = find_task_of_prio(self, prio, is_global_first);
+            if (task != NULL) {
+                return task;
+            }
+        }
+    }
+
+    struct queue_entry *task = steal_lifo_slot(self);
+    if (task == NULL && is_pinned()) {
+        task = steal_inbox(self);
+    }
+    return task;
+}
+
+/**
+ * @brief  Switch from the running task back to its executor
+ * @note   The executor publishes the task according to kind once it is switched out
+ * @param  kind: Where the task should go
+ * @retval None
+ */
+void switch_to_parent(pending_kind kind) {
+    threaddesc *parent = get_current_executor();
+
+    parent->pending_kind = kind;
+    parent->current_task->need_resched = false;
+
+    sut_context_switch(&parent->current_task->context, &parent->parent_thread);
+}
+
+/**
+ * @brief  Park the running task until unpark_task()
+ * @note   fn is called by the executor after the switch, so an unpark can never race the switch
+ * @param  fn: Records the task where it will be unparked from
+ * @param  *arg: The argument of fn
+ * @retval None
+ */
+void park_task(park_f fn, void *arg) {
+    threaddesc *parent = get_current_executor();
+
+    parent->park_fn = fn;
+    parent->park_arg = arg;
+    switch_to_parent(PENDING_PARK);
+}
+
+/**
+ * @brief  Allow the task to be preempted again
+ * @note   Yields at once if a tick came in between
+ * @param  *task: The running task, NULL outside of a task
+ * @retval None
+ */
+void preempt_enable(taskdesc *task) {
+    if (task == NULL || --task->preempt_off > 0 || !task->need_resched) {
+        return;
+    }
+
+    task->preempt_off++;
+    switch_to_parent(PENDING_PREEMPT);
+    task->preempt_off--;
+}
+
+/**
+ * @brief  Whether the task was interrupted in the program's own code
+ * @note   Inside the C library, or anything else dynamically linked, it may hold a lock another task
+ *         on the same executor would wait for forever
+ * @param  *context: The ucontext_t the signal handler got
+ * @retval Whether the task can be switched out from the handler
+ */
+bool is_preemptible_pc(void *context) {
+#if defined(__x86_64__)
+    extern char __executable_start[];
+    extern char etext[];
+    char *pc = (char *)((ucontext_t *)context)->uc_mcontext.gregs[REG_RIP];
+
+    return pc >= __executable_start && pc < etext;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief  The SIGURG handler of the preemption timer, it switches the running task out
+ * @note   Runs on the stack of the interrupted task. A task is only preempted after it had the
+ *         C_EXEC for a whole tick, outside of the runtime and of the shared libraries
+ * @retval None
+ */
+void preempt_handler(int sig, siginfo_t *info, void *context) {
+    (void)sig;
+    (void)info;
+    threaddesc *self = current_executor;
+    if (!is_CEXEC(self) || self->current_task == NULL) {
+        return;
+    }
+
+    unsigned long switches = atomic_load_explicit(&self->num_of_switches, memory_order_relaxed);
+    if (switches != self->preempt_seen_switches) {
+        self->preempt_seen_switches = switches;
+        return;
+    }
+
+    // current_task is already set while the C_EXEC switches to it on its own stack
+    taskdesc *task = self->current_task;
+    char *frame = (char *)__builtin_frame_address(0);
+    if (frame < task->stack || frame >= task->stack + task->stack_size) {
+        return;
+    }
+
+    if (task->preempt_off > 0) {
+        task->need_resched = true;
+        return;
+    }
+    if (!is_preemptible_pc(context)) {
+        return;
+    }
+
+    int saved_errno = errno;
+    atomic_fetch_add_explicit(&self->num_of_preemptions, 1, memory_order_relaxed);
+
+    // The task may resume on another C_EXEC, self must not be used after this
+    task->preempt_off++;
+    switch_to_parent(PENDING_PREEMPT);
+    task->preempt_off--;
+
+    errno = saved_errno;
+}
+
+/**
+ * @brief  The first function of every task's context
+ * @note   A task returning from its function exits as if it called sut_exit()
+ * @retval None
+ */
+void task_main() {
+    taskdesc *task = get_running_task();
+
+    // A new task starts with preemption disabled, until it is off the runtime's code
+    preempt_enable(task);
+
+    if (task->fn != NULL) {
+        task->fn();
+    } else {
+        void *result = task->arg_fn(task->arg);
+        if (task->result != NULL) {
+            *task->result = result;
+        }
+    }
+
+    sut_exit();
+}
+
+// ------------------ Main Functions ------------------
+
+/**
+ * @brief  Register the current thread in its description
+ * @note
+ * @param  *desc: The description of the executor
+ * @retval None
+ */
+void register_executor(threaddesc *desc) {
+    current_executor = desc;
+    desc->thread_id = syscall(SYS_gettid);
+
+    pthread_mutex_lock(&num_of_thread_lock);
+    num_of_thread++;
+    pthread_mutex_unlock(&num_of_thread_lock);
+}
+
+/**
+ * @brief  Run the task and publish it after it switched back
+ * @note
+ * @param  *self: The description of the current executor
+ * @param  *next_task: The queue_entry of the task
+ * @retval None
+ */
+void run_task(threaddesc *self, struct queue_entry *next_task) {
+    self->current_task = (taskdesc *)next_task->data;
+    self->current_task->executor = self;
+    self->current_task->state = TASK_RUNNING;
+    // Only this C_EXEC writes it, a load and a store are enough
+    atomic_store_explicit(&self->num_of_switches,
+                          atomic_load_explicit(&self->num_of_switches, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+
+    uint64_t start_ns = 0;
+    if (is_stats_enabled) {
+        start_ns = clock_ns();
+        histogram_record(&self->queue_wait, start_ns - self->current_task->ready_ns);
+    }
+    uint64_t trace_start = 0;
+    if (trace_path != NULL) {
+        trace_start = trace_clock();
+        trace_ring_record(&self->trace, TRACE_READY, self->current_task->trace_ready, trace_start,
+                          self->current_task->id, !self->current_task->has_started);
+        self->current_task->has_started = true;
+    }
+
+    running_task = self->current_task;
+    sut_context_switch(&self->parent_thread, &self->current_task->context);
+    running_task = NULL;
+
+    if (is_stats_enabled) {
+        histogram_record(&self->run_slice, clock_ns() - start_ns);
+    }
+    if (trace_path != NULL) {
+        trace_ring_record(&self->trace, TRACE_RUN, trace_start, trace_clock(), self->current_task->id,
+                          self->pending_kind);
+    }
+
+    publish_pending(self);
+}
+
+/**
+ * @brief  The first tick at or after a time
+ */
+uint64_t ns_to_tick(uint64_t ns) { return (ns + ((uint64_t)1 << TIMER_TICK_BITS) - 1) >> TIMER_TICK_BITS; }
+
+/**
+ * @brief  Put a task whose sleep is over back to the ready queue, the fire function of the timers
+ * @param  *timer: The timer of the task
+ * @param  *arg: The description of the current C_EXEC
+ * @retval None
+ */
+void wake_sleeping_task(struct timer_node *timer, void *arg) {
+    taskdesc *task = (taskdesc *)timer->data;
+
+    task->state = TASK_READY;
+    make_ready((threaddesc *)arg, &task->entry);
+}
+
+/**
+ * @brief  Wake the tasks of the C_EXEC whose sleep is over
+ * @note   Only reads the clock while some task sleeps
+ * @param  *self: The description of the current C_EXEC
+ * @retval None
+ */
+void expire_timers(threaddesc *self) {
+    if (self->timers.num_of_timers > 0) {
+        timer_wheel_advance(&self->timers, clock_ns() >> TIMER_TICK_BITS, wake_sleeping_task, self);
+    }
+}
+
+/**
+ * @brief  When the C_EXEC has to look at its timers next
+ * @retval The time on CLOCK_MONOTONIC, UINT64_MAX while no task sleeps on it
+ */
+uint64_t get_next_timer_ns(threaddesc *self) {
+    uint64_t tick = timer_wheel_next_tick(&self->timers);
+    return tick == UINT64_MAX ? UINT64_MAX : tick << TIMER_TICK_BITS;
+}
+
+/**
+ * @brief  When a parked C_EXEC has to wake up anyway
+ * @note   For its next timer, or to steal a lifo_slot that was too young at its last look
+ * @retval The time on CLOCK_MONOTONIC, UINT64_MAX for never
+ */
+uint64_t get_cexec_deadline_ns(threaddesc *self) {
+    uint64_t timer_ns = get_next_timer_ns(self);
+    return timer_ns < self->next_slot_steal_ns ? timer_ns : self->next_slot_steal_ns;
+}
+
+/**
+ * @brief  Get the time slice of the tasks
+ * @note   SUT_QUANTUM_US sets it in microseconds
+ * @retval The quantum in microseconds, 0 for cooperative scheduling
+ */
+long get_preempt_quantum() {
+    char *configured = getenv("SUT_QUANTUM_US");
+    long quantum = configured ? strtol(configured, NULL, 10) : 0;
+
+    return quantum < 0 ? 0 : quantum;
+}
+
+/**
+ * @brief  Get the capacity of the lock-free rings of the shared_queues
+ * @note   SUT_QUEUE_CAPACITY overrides SHARED_QUEUE_CAPACITY. What does not fit goes to a locked list
+ */
+size_t get_queue_capacity() {
+    char *configured = getenv("SUT_QUEUE_CAPACITY");
+    long capacity = configured ? strtol(configured, NULL, 10) : (long)SHARED_QUEUE_CAPACITY;
+
+    return capacity < 1 ? 1 : (size_t)capacity;
+}
+
+/**
+ * @brief  Get how many events each executor keeps for the trace
+ * @note   SUT_TRACE_EVENTS overrides TRACE_EVENTS, the older ones are overwritten
+ */
+size_t get_trace_events() {
+    char *configured = getenv("SUT_TRACE_EVENTS");
+    long num = configured ? strtol(configured, NULL, 10) : (long)TRACE_EVENTS;
+
+    return num < 1 ? 1 : (size_t)num;
+}
+
+/**
+ * @brief  Get how an idle executor waits
+ * @note   SUT_IDLE=spin polls for SUT_IDLE_SPIN_US microseconds, 50 by default, before parking
+ * @param  *spin_us: Set to how long it polls
+ * @retval SUT_IDLE_PARK or SUT_IDLE_SPIN
+ */
+int get_idle_policy(long *spin_us) {
+    char *configured = getenv("SUT_IDLE");
+    char *configured_us = getenv("SUT_IDLE_SPIN_US");
+    long us = configured_us ? strtol(configured_us, NULL, 10) : 50;
+
+    *spin_us = us < 0 ? 0 : us;
+    return configured != NULL && strcmp(configured, "spin") == 0 ? SUT_IDLE_SPIN : SUT_IDLE_PARK;
+}
+
+/**
+ * @brief  Create the timer that preempts the tasks of the C_EXEC
+ * @note   The signal goes to the C_EXEC's own thread. Without a timer the C_EXEC stays cooperative
+ * @param  *self: The description of the current C_EXEC
+ * @retval None
+ */
+void create_preempt_timer(threaddesc *self) {
+    if (preempt_quantum_us == 0) {
+        return;
+    }
+
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGURG;
+    sev._sigev_un._tid = self->thread_id; // sigev_notify_thread_id, which older glibc does not define
+
+    self->has_preempt_timer = timer_create(CLOCK_MONOTONIC, &sev, &self->preempt_timer) == 0;
+}
+
+/**
+ * @brief  Start or stop the ticks of the preemption timer
+ * @note   A parked C_EXEC stops them, or it would be woken every quantum for nothing
+ * @param  *self: The description of the current C_EXEC
+ * @param  armed: Whether the timer should tick
+ * @retval None
+ */
+void set_preempt_timer(threaddesc *self, bool armed) {
+    if (!self->has_preempt_timer) {
+        return;
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (armed) {
+        spec.it_value.tv_sec = preempt_quantum_us / 1000000;
+        spec.it_value.tv_nsec = preempt_quantum_us % 1000000 * 1000;
+        spec.it_interval = spec.it_value;
+    }
+    timer_settime(self->preempt_timer, 0, &spec, NULL);
+}
+
+void *C_EXEC(void *arg) {
+    threaddesc *self = (threaddesc *)arg;
+
+    register_executor(self);
+    create_preempt_timer(self);
+    set_preempt_timer(self, true);
+
+    while (true) {
+        expire_timers(self);
+
+        // Get the next queue_entry to be run
+        struct queue_entry *next_task = find_ready_task(self);
+
+        // While there is no ready task anywhere, park until make_ready() notifies, a timer is due or a
+        // lifo_slot may be stolen
+        if (next_task == NULL) {
+            set_preempt_timer(self, false);
+            next_task = park_executor(self, &ready_event, find_ready_task, get_cexec_deadline_ns);
+            set_preempt_timer(self, true);
+        }
+
+        if (next_task != NULL) {
+            run_task(self, next_task);
+        } else if (should_exit()) {
+            if (self->has_preempt_timer) {
+                timer_delete(self->preempt_timer);
+            }
+            pthread_exit(NULL);
+        }
+    }
+}
+
+/**
+ * @brief  Take the iodesc at the head of the wait_queue
+ * @note
+ * @param  *self: The description of the current I_EXEC
+ * @retval The queue_entry of the iodesc, NULL if the queue is empty
+ */
+struct queue_entry *find_wait_io(threaddesc *self) { return shared_queue_pop(&self->wait_queue); }
+
+/**
+ * @brief  Whether the wait_queue of the I_EXEC has an iodesc
+ */
+bool has_waiting_io(threaddesc *self) { return !shared_queue_is_empty(&self->wait_queue); }
+
+/**
+ * @brief  Do the I/O with a blocking system call
+ * @note
+ * @param  *io: The iodesc, its result is set
+ * @retval None
+ */
+void perform_io(iodesc *io) {
+    int result = -1;
+
+    // Only waits for a pipe, a socket or a terminal, a regular file is always ready
+    if (io->timeout_ns > 0 && (io->op == IO_READ || io->op == IO_WRITE)) {
+        struct pollfd pfd = {.fd = io->fd, .events = io->op == IO_READ ? POLLIN : POLLOUT};
+        int timeout_ms = (int)((io->timeout_ns + 999999) / 1000000);
+        if (poll(&pfd, 1, timeout_ms) == 0) {
+            io->result = -ETIME;
+            return;
+        }
+    }
+
+    switch (io->op) {
+    case IO_OPEN:
+        result = open(io->path, O_RDWR | io->open_flags, 0777);
+        break;
+    case IO_READ:
+        result = read(io->fd, io->buf, io->size);
+        break;
+    case IO_WRITE:
+        result = write(io->fd, io->buf, io->size);
+        break;
+    case IO_CLOSE:
+        result = close(io->fd);
+        break;
+    }
+
+    io->result = result < 0 ? -errno : result;
+}
+
+/**
+ * @brief  Finish a completed I/O
+ * @note   The iodesc must not be used after this, the task of an asynchronous one may already be
+ *         running. The caller makes the task it returns ready
+ * @param  *self: The description of the current I_EXEC
+ * @param  *io: The iodesc
+ * @retval The task to make ready, NULL for an asynchronous I/O nobody awaits yet
+ */
+taskdesc *complete_io(threaddesc *self, iodesc *io) {
+    counter_add(&self->num_of_ios, 1);
+    if (is_stats_enabled) {
+        histogram_record(&self->io_turnaround, clock_ns() - io->submit_ns);
+    }
+    if (trace_path != NULL) {
+        trace_ring_record(&self->trace, TRACE_IO, io->trace_start, trace_clock(),
+                          io->task != NULL ? io->task->id : 0, io->op);
+    }
+
+    if (io->task != NULL) {
+        return io->task;
+    }
+
+    // Asynchronous, wake the task if it is already parked in sut_await()
+    taskdesc *waiter = (taskdesc *)atomic_exchange(&io->waiter, IO_DONE);
+    if (waiter != NULL) {
+        waiter->state = TASK_READY;
+    }
+    return waiter;
+}
+
+/**
+ * @brief  Mark an fd as having an I/O in flight or not
+ * @note   I/Os on one fd are submitted one at a time, so they happen in the order they were asked
+ * @param  *self: The description of the current I_EXEC
+ * @param  fd: The file descriptor
+ * @param  busy: Whether an I/O on fd is in flight
+ * @retval None
+ */
+void set_fd_busy(threaddesc *self, int fd, bool busy) {
+    if (fd >= self->fd_busy_size) {
+        int size = self->fd_busy_size ? self->fd_busy_size : 64;
+        while (size <= fd) {
+            size *= 2;
+        }
+        self->fd_busy = (unsigned char *)realloc(self->fd_busy, size);
+        memset(self->fd_busy + self->fd_busy_size, 0, size - self->fd_busy_size);
+        self->fd_busy_size = size;
+    }
+    self->fd_busy[fd] = busy;
+}
+
+bool is_fd_busy(threaddesc *self, int fd) { return fd < self->fd_busy_size && self->fd_busy[fd]; }
+
+/**
+ * @brief  Arm a read on wait_event's eventfd, it completes when eventcount_notify() writes it
+ * @note   One SQE is always kept free for it
+ * @param  *self: The description of the current I_EXEC
+ * @retval None
+ */
+void arm_event_fd(threaddesc *self) {
+    struct io_uring_sqe *sqe = io_ring_get_sqe(self->ring);
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = self->wait_event.event_fd;
+    sqe->addr = (uintptr_t)&self->event_buf;
+    sqe->len = sizeof(self->event_buf);
+    sqe->user_data = 0;
+}
+
+/**
+ * @brief  Fill SQEs with the I/Os of the backlog that can start now
+ * @note   An I/O stays in the backlog while its fd is busy or the ring is full
+ * @param  *self: The description of the current I_EXEC
+ * @retval None
+ */
+void submit_backlog(threaddesc *self) {
+    struct queue backlog = queue_create();
+    queue_init(&backlog);
+    queue_concat(&backlog, &self->io_backlog);
+
+    struct queue_entry *entry;
+    while ((entry = queue_pop_head(&backlog)) != NULL) {
+        iodesc *io = (iodesc *)entry->data;
+        bool has_fd = io->op != IO_OPEN;
+        int buf_index;
+        bool has_timeout = io->timeout_ns > 0 && (io->op == IO_READ || io->op == IO_WRITE);
+
+        // One SQE is kept for arm_event_fd(), a timeout takes a second one
+        struct io_uring_sqe *sqe = NULL;
+        if (self->num_of_inflight < self->ring->sq_entries - 1 &&
+            io_ring_sq_space(self->ring) > (has_timeout ? 2 : 1) && !(has_fd && is_fd_busy(self, io->fd))) {
+            sqe = io_ring_get_sqe(self->ring);
+        }
+        if (sqe == NULL) {
+            queue_insert_tail(&self->io_backlog, entry);
+            continue;
+        }
+
+        switch (io->op) {
+        case IO_OPEN:
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)io->path;
+            sqe->len = 0777;
+            sqe->open_flags = O_RDWR | io->open_flags;
+            break;
+        case IO_READ:
+        case IO_WRITE:
+            sqe->opcode = io->op == IO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe->fd = io->fd;
+            sqe->addr = (uintptr_t)io->buf;
+            sqe->len = io->size;
+            sqe->off = (uint64_t)-1; // At the file position, like read() and write()
+            // A leased buffer is already pinned
+            buf_index = self->has_fixed_bufs ? get_pool_buf_index(io->buf, io->size) : -1;
+            if (buf_index >= 0) {
+                sqe->opcode = io->op == IO_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+                sqe->buf_index = buf_index;
+            }
+            break;
+        case IO_CLOSE:
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = io->fd;
+            break;
+        }
+        sqe->user_data = (uintptr_t)io;
+
+        // The kernel cancels the I/O if it is still running at the timeout
+        if (has_timeout) {
+            sqe->flags |= IOSQE_IO_LINK;
+            io->timeout.tv_sec = io->timeout_ns / 1000000000;
+            io->timeout.tv_nsec = io->timeout_ns % 1000000000;
+
+            struct io_uring_sqe *timeout_sqe = io_ring_get_sqe(self->ring);
+            timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+            timeout_sqe->addr = (uintptr_t)&io->timeout;
+            timeout_sqe->len = 1;
+            timeout_sqe->user_data = IO_TIMEOUT_USER_DATA;
+        }
+
+        self->num_of_inflight++;
+        if (has_fd) {
+            set_fd_busy(self, io->fd, true);
+        }
+    }
+}
+
+/**
+ * @brief  Handle every completion in the ring
+ * @note
+ * @param  *self: The description of the current I_EXEC
+ * @retval Whether there was a completion
+ */
+bool reap_completions(threaddesc *self) {
+    struct io_uring_cqe cqe;
+    bool has_completion = false;
+    struct queue_entry *completed[IO_READY_BATCH];
+    size_t num_of_completed = 0;
+
+    while (io_ring_pop_cqe(self->ring, &cqe)) {
+        has_completion = true;
+
+        if (cqe.user_data == 0) {
+            arm_event_fd(self);
+            continue;
+        }
+        if (cqe.user_data == IO_TIMEOUT_USER_DATA) {
+            continue;
+        }
+
+        iodesc *io = (iodesc *)(uintptr_t)cqe.user_data;
+        io->result = cqe.res;
+        // Cancelled by its linked timeout
+        if (io->timeout_ns > 0 && cqe.res == -ECANCELED) {
+            io->result = -ETIME;
+        }
+        self->num_of_inflight--;
+        if (io->op != IO_OPEN) {
+            set_fd_busy(self, io->fd, false);
+        }
+
+        taskdesc *task = complete_io(self, io);
+        if (task != NULL) {
+            completed[num_of_completed++] = &task->entry;
+        }
+        if (num_of_completed == IO_READY_BATCH) {
+            make_ready_completed(completed, num_of_completed);
+            num_of_completed = 0;
+        }
+    }
+
+    make_ready_completed(completed, num_of_completed);
+    return has_completion;
+}
+
+/**
+ * @brief  The I_EXEC loop with io_uring
+ * @note   Every waiting I/O is submitted in one io_uring_enter(), so they overlap
+ * @param  *self: The description of the current I_EXEC
+ * @retval None
+ */
+void io_uring_loop(threaddesc *self) {
+    arm_event_fd(self);
+
+    while (true) {
+        struct queue_entry *io;
+        while ((io = find_wait_io(self)) != NULL) {
+            queue_insert_tail(&self->io_backlog, io);
+        }
+
+        submit_backlog(self);
+        io_ring_enter(self->ring, 0);
+
+        // A completion may free an fd some I/O of the backlog waits for
+        if (reap_completions(self)) {
+            continue;
+        }
+
+        // Sleep until an I/O completes or eventcount_notify() writes the eventfd
+        eventcount_prepare(&self->wait_event);
+        if (has_waiting_io(self) || (should_exit() && self->num_of_inflight == 0)) {
+            eventcount_cancel(&self->wait_event);
+            if (should_exit()) {
+                return;
+            }
+            continue;
+        }
+
+        atomic_fetch_add_explicit(&self->num_of_parks, 1, memory_order_relaxed);
+        io_ring_enter(self->ring, 1);
+        eventcount_cancel(&self->wait_event);
+        atomic_fetch_add_explicit(&self->num_of_wakeups, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief  The I_EXEC loop without io_uring, one blocking system call at a time
+ * @note
+ * @param  *self: The description of the current I_EXEC
+ * @retval None
+ */
+void blocking_io_loop(threaddesc *self) {
+    while (true) {
+        // Get the next queue_entry to be run
+        struct queue_entry *next_io = find_wait_io(self);
+
+        // While the wait_queue is empty, park until a task asks for an I/O
+        if (next_io == NULL) {
+            next_io = park_executor(self, &self->wait_event, find_wait_io, NULL);
+        }
+
+        if (next_io != NULL) {
+            iodesc *io = (iodesc *)next_io->data;
+            perform_io(io);
+            taskdesc *task = complete_io(self, io);
+            if (task != NULL) {
+                make_ready(self, &task->entry);
+            }
+        } else if (should_exit()) {
+            return;
+        }
+    }
+}
+
+void *I_EXEC(void *arg) {
+    threaddesc *self = (threaddesc *)arg;
+
+    register_executor(self);
+
+    if (self->ring != NULL) {
+        io_uring_loop(self);
+    } else {
+        blocking_io_loop(self);
+    }
+
+    pthread_exit(NULL);
+}
+
+/**
+ * @brief  Hand the I/O to the I_EXEC and park the task until it completes
+ * @note
+ * @param  *io: The iodesc, on the stack of the task
+ * @retval None
+ */
+void wait_for_io(iodesc *io) {
+    taskdesc *task = get_running_task();
+    preempt_disable(task);
+
+    io->task = task;
+    io->entry.data = io;
+    task->io = io;
+
+    switch_to_parent(PENDING_WAIT);
+
+    preempt_enable(task);
+}
+
+/**
+ * @brief  Start an I/O without waiting for it
+ * @note
+ * @param  op: The operation
+ * @param  fd: The file descriptor
+ * @param  *buf: The buffer, it must stay valid until sut_await()
+ * @param  size: The size of the buffer
+ * @retval The token for sut_await(), NULL outside of a task
+ */
+sut_io_t start_async_io(io_op op, int fd, char *buf, int size) {
+    taskdesc *task = get_running_task();
+    if (task == NULL) {
+        return NULL;
+    }
+
+    iodesc *io = (iodesc *)calloc(1, sizeof(iodesc));
+    io->op = op;
+    io->fd = fd;
+    io->buf = buf;
+    io->size = size;
+    io->entry.data = io;
+    atomic_init(&io->waiter, 0);
+
+    preempt_disable(task);
+    submit_io(io);
+    preempt_enable(task);
+
+    return (sut_io_t)io;
+}
+
+/**
+ * @brief  Record the awaiting task on the asynchronous I/O, the park_f of sut_await()
+ * @note
+ * @param  *task: The taskdesc of the awaiting task
+ * @param  *arg: The iodesc
+ * @retval Whether the I/O is still in flight, otherwise the task goes on at once
+ */
+bool park_on_io(taskdesc *task, void *arg) {
+    iodesc *io = (iodesc *)arg;
+    uintptr_t pending = 0;
+
+    return atomic_compare_exchange_strong(&io->waiter, &pending, (uintptr_t)task);
+}
+
+/**
+ * @brief  Fill a sut_config with the settings sut_init() uses
+ * @note   The SUT_* environment variables where they are set, the defaults otherwise
+ * @param  *config: The sut_config to fill
+ * @retval None
+ */
+void sut_config_init(struct sut_config *config) {
+    memset(config, 0, sizeof(struct sut_config));
+    config->num_of_cexec = get_num_of_CEXEC();
+    config->num_of_iexec = get_num_of_IEXEC();
+    config->stack_size = get_task_stack_size();
+    config->queue_capacity = get_queue_capacity();
+    config->idle_policy = get_idle_policy(&config->idle_spin_us);
+    config->use_io_uring = getenv("SUT_IO_URING") == NULL || strcmp(getenv("SUT_IO_URING"), "0") != 0;
+    config->quantum_us = get_preempt_quantum();
+    config->is_stats_enabled = getenv("SUT_STATS") != NULL && strcmp(getenv("SUT_STATS"), "0") != 0;
+    config->buf_size = get_buf_size();
+    config->num_of_bufs = get_num_of_bufs();
+    config->cpus = getenv("SUT_CPUS");
+    config->trace_path = getenv("SUT_TRACE");
+    config->trace_events = get_trace_events();
+}
+
+/**
+ * @brief  Initialize the queues, CEXEC and IEXEC from the SUT_* environment variables
+ * @note
+ * @retval None
+ */
+void sut_init() {
+    struct sut_config config;
+    sut_config_init(&config);
+    sut_init_ex(&config);
+}
+
+/**
+ * @brief  Initialize the queues, CEXEC and IEXEC with the given settings
+ * @note   Start from sut_config_init(). Counts below 1 are raised to 1, the sizes are rounded up to
+ *         whole pages, the queue capacity to a power of two. Preemption is only supported on x86-64
+ * @param  *config: The settings, only read during the call
+ * @retval None
+ */
+void sut_init_ex(const struct sut_config *config) {
+    num_of_thread = 0;
+    atomic_init(&num_of_task_ids, 0);
+    num_of_user_threads = 0;
+    num_of_CEXEC = config->num_of_cexec < 1 ? 1 : config->num_of_cexec;
+    num_of_IEXEC = config->num_of_iexec < 1 ? 1 : config->num_of_iexec;
+    atomic_init(&num_of_opens, 0);
+    page_size = sysconf(_SC_PAGESIZE);
+    task_stack_size = round_stack_size(config->stack_size);
+    atomic_init(&num_of_guards_left, get_num_of_guards());
+#if defined(__x86_64__)
+    preempt_quantum_us = config->quantum_us < 0 ? 0 : config->quantum_us;
+#else
+    preempt_quantum_us = 0;
+#endif
+    shared_queue_capacity = config->queue_capacity < 1 ? 1 : config->queue_capacity;
+    idle_policy = config->idle_policy;
+    idle_spin_us = config->idle_spin_us < 0 ? 0 : config->idle_spin_us;
+    is_io_uring_enabled = config->use_io_uring;
+    num_of_executor_cpus = get_executor_cpus(config->cpus, &executor_cpus);
+    num_of_nodes = get_num_of_nodes();
+    is_stats_enabled = config->is_stats_enabled;
+    trace_path = NULL;
+    if (config->trace_path != NULL && config->trace_path[0] != '\0') {
+        trace_path = strdup(config->trace_path);
+    }
+    trace_start_tsc = trace_clock();
+    trace_start_ns = clock_ns();
+    is_running = true;
+    atomic_init(&is_runtime_done, false);
+    atomic_init(&ready_event.epoch, 0);
+    atomic_init(&ready_event.num_of_waiters, 0);
+    atomic_init(&join_event.epoch, 0);
+    atomic_init(&join_event.num_of_waiters, 0);
+    ready_event.event_fd = -1;
+    join_event.event_fd = -1;
+    // Initialize the queues
+    for (int i = 0; i < SUT_NUM_PRIO; i++) {
+        shared_queue_init(&ready_queue[i]);
+    }
+    free_task_queues = (struct queue *)malloc(sizeof(struct queue) * num_of_nodes);
+    for (int i = 0; i < num_of_nodes; i++) {
+        queue_init(&free_task_queues[i]);
+    }
+    queue_init(&task_slab_queue);
+    live_tasks_size = 256;
+    live_tasks = (taskdesc **)calloc(live_tasks_size, sizeof(taskdesc *));
+    num_of_live_tasks = 0;
+
+    // Initilize the mutex locks
+    pthread_mutex_init(&num_of_thread_lock, NULL);
+    pthread_mutex_init(&num_of_user_thread_lock, NULL);
+    pthread_mutex_init(&task_pool_lock, NULL);
+    pthread_mutex_init(&live_tasks_lock, NULL);
+
+    // Every description exists before any executor starts, a C_EXEC may steal from any of them
+    thread_array = (threaddesc **)malloc(sizeof(threaddesc *) * (num_of_CEXEC + num_of_IEXEC));
+    for (int i = 0; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        thread_array[i] = (threaddesc *)calloc(1, sizeof(threaddesc));
+        thread_array[i]->index = i;
+        thread_array[i]->steal_seed = i + 1;
+        thread_array[i]->next_slot_steal_ns = UINT64_MAX;
+        thread_array[i]->cpu = is_pinned() ? executor_cpus[i % num_of_executor_cpus] : -1;
+        thread_array[i]->node = is_pinned() ? get_cpu_node(thread_array[i]->cpu) : -1;
+        if (is_pinned() && i < num_of_CEXEC) {
+            shared_queue_init(&thread_array[i]->inbox);
+        }
+        for (int j = 0; j < SUT_NUM_PRIO; j++) {
+            steal_queue_init(&thread_array[i]->local_queue[j]);
+        }
+        queue_init(&thread_array[i]->io_backlog);
+        timer_wheel_init(&thread_array[i]->timers, clock_ns() >> TIMER_TICK_BITS);
+    }
+    for (int i = 0; trace_path != NULL && i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        if (!trace_ring_init(&thread_array[i]->trace, config->trace_events)) {
+            perror("SUT trace");
+            free(trace_path);
+            trace_path = NULL;
+        }
+    }
+
+    init_buffer_pool(config->buf_size, config->num_of_bufs);
+
+    // With io_uring an I_EXEC sleeps in io_uring_enter(), it is woken through an eventfd
+    for (int i = num_of_CEXEC; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        threaddesc *iexec = thread_array[i];
+        shared_queue_init(&iexec->wait_queue);
+        atomic_init(&iexec->wait_event.epoch, 0);
+        atomic_init(&iexec->wait_event.num_of_waiters, 0);
+        iexec->wait_event.event_fd = -1;
+
+        iexec->ring = get_io_ring();
+        if (iexec->ring != NULL) {
+            iexec->wait_event.event_fd = eventfd(0, EFD_CLOEXEC);
+            iexec->has_fixed_bufs = register_buffer_pool(iexec->ring);
+        }
+    }
+
+    // SA_NODEFER: a task switched out in the handler must not leave SIGURG blocked on its C_EXEC
+    if (preempt_quantum_us > 0) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = preempt_handler;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGURG, &action, &old_preempt_action);
+    }
+
+    CEXEC = (pthread_t *)malloc(sizeof(pthread_t) * num_of_CEXEC);
+    IEXEC = (pthread_t *)malloc(sizeof(pthread_t) * num_of_IEXEC);
+
+    // A pinned executor starts on its CPU, so what it allocates first is already local
+    for (int i = 0; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (thread_array[i]->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(thread_array[i]->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        if (i < num_of_CEXEC) {
+            pthread_create(&CEXEC[i], &attr, C_EXEC, thread_array[i]);
+        } else {
+            pthread_create(&IEXEC[i - num_of_CEXEC], &attr, I_EXEC, thread_array[i]);
+        }
+        pthread_attr_destroy(&attr);
+    }
+}
+
+/**
+ * @brief  Set up a taskdesc from the pool for a new task, ready to run from task_main
+ * @note
+ * @param  *new_task: The taskdesc, with its stack
+ * @param  id: The id of the task
+ * @param  fn: The task needed to be excuted, NULL to run arg_fn
+ * @param  arg_fn: The task taking an argument
+ * @param  *arg: The argument of arg_fn
+ * @param  **result: Where the value arg_fn returns is written, or NULL
+ * @param  prio: The priority of the task
+ * @retval None
+ */
+void init_task(taskdesc *new_task, unsigned long id, sut_task_f fn, sut_task_arg_f arg_fn, void *arg,
+               void **result, int prio) {
+    new_task->id = id;
+    new_task->state = TASK_READY;
+    new_task->executor = NULL;
+    new_task->fn = fn;
+    new_task->arg_fn = arg_fn;
+    new_task->arg = arg;
+    new_task->result = result;
+    new_task->base_prio = prio;
+    new_task->prio = prio;
+    new_task->preempt_off = 1;
+    new_task->need_resched = false;
+    new_task->has_started = false;
+    queue_init(&new_task->joiners);
+
+    sut_context_make(&new_task->context, new_task->stack, new_task->stack_size, task_main);
+}
+
+/**
+ * @brief  Create a task running either fn or arg_fn(arg), and add it into the ready_queue
+ * @note   A task created from a C_EXEC goes to that C_EXEC's local_queue
+ * @param  fn: The task needed to be excuted, NULL to run arg_fn
+ * @param  arg_fn: The task taking an argument
+ * @param  *arg: The argument of arg_fn
+ * @param  **result: Where the value arg_fn returns is written, or NULL
+ * @param  stack_size: The stack size of the task, a multiple of page_size
+ * @param  prio: The priority of the task
+ * @retval The handle of the task for sut_join(), never 0
+ */
+sut_task_t create_task(sut_task_f fn, sut_task_arg_f arg_fn, void *arg, void **result,
+                       size_t stack_size, int prio) {
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+
+    pthread_mutex_lock(&num_of_user_thread_lock);
+    num_of_user_threads++;
+    pthread_mutex_unlock(&num_of_user_thread_lock);
+
+    // Create the context for coming task, on a stack from the task pool
+    taskdesc *new_task = alloc_task(stack_size);
+    init_task(new_task, atomic_fetch_add_explicit(&num_of_task_ids, 1, memory_order_relaxed) + 1, fn,
+              arg_fn, arg, result, prio);
+
+    // Joinable before it can run, and exit
+    sut_task_t handle = new_task->id;
+    add_live_task(new_task);
+
+    // store the current context into the ready queue
+    make_ready(get_current_executor(), &new_task->entry);
+
+    preempt_enable(self);
+
+    return handle;
+}
+
+/**
+ * @brief  add the task into the ready_queue
+ * @note
+ * @param  fn: The task needed to be excuted
+ * @retval The handle of the task for sut_join(), never 0
+ */
+sut_task_t sut_create(sut_task_f fn) {
+    return create_task(fn, NULL, NULL, NULL, task_stack_size, SUT_PRIO_NORMAL);
+}
+
+/**
+ * @brief  Create a task running fn(arg)
+ * @note   What fn returns is dropped, see sut_create_future() to keep it
+ * @param  fn: The task needed to be excuted
+ * @param  *arg: Its argument, it must stay valid while the task may use it
+ * @retval The handle of the task for sut_join(), never 0
+ */
+sut_task_t sut_create_arg(sut_task_arg_f fn, void *arg) {
+    return create_task(NULL, fn, arg, NULL, task_stack_size, SUT_PRIO_NORMAL);
+}
+
+/**
+ * @brief  Create n tasks running fns[i](args[i]) at once
+ * @note   The taskdescs are taken from the task pool under one lock, their ids with one atomic
+ *         operation, and they are put to the ready queues together before waking the C_EXECs, so a
+ *         batch costs much less than n calls of sut_create_arg(). They get consecutive handles
+ * @param  *fns: The tasks needed to be excuted, the same function may appear many times
+ * @param  *args: Their arguments, NULL for all NULL
+ * @param  n: The number of tasks
+ * @param  *tasks: Filled with their handles for sut_join(), or NULL
+ * @retval The number of tasks created, n
+ */
+size_t sut_create_batch(const sut_task_arg_f *fns, void *const *args, size_t n, sut_task_t *tasks) {
+    if (n == 0) {
+        return 0;
+    }
+
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+
+    pthread_mutex_lock(&num_of_user_thread_lock);
+    num_of_user_threads += n;
+    pthread_mutex_unlock(&num_of_user_thread_lock);
+
+    struct queue_entry **entries = (struct queue_entry **)malloc(sizeof(struct queue_entry *) * n);
+    alloc_tasks(entries, n);
+
+    unsigned long first_id = atomic_fetch_add_explicit(&num_of_task_ids, n, memory_order_relaxed) + 1;
+    for (size_t i = 0; i < n; i++) {
+        init_task((taskdesc *)entries[i]->data, first_id + i, NULL, fns[i], args == NULL ? NULL : args[i],
+                  NULL, SUT_PRIO_NORMAL);
+        if (tasks != NULL) {
+            tasks[i] = first_id + i;
+        }
+    }
+
+    // Joinable before they can run, and exit
+    add_live_tasks(entries, n);
+    make_ready_batch(get_current_executor(), entries, n, SUT_PRIO_NORMAL);
+
+    free(entries);
+    preempt_enable(self);
+
+    return n;
+}
+
+/**
+ * @brief  Create a task running fn(arg) with a priority
+ * @note   A ready task of a higher priority always runs first, except that every AGING_INTERVAL
+ *         dispatches the lower ones go first. With SUT_QUANTUM_US a task that keeps being preempted
+ *         drops a level, down to SUT_PRIO_LOW, until it gives the C_EXEC up by itself
+ * @param  fn: The task needed to be excuted
+ * @param  *arg: Its argument, it must stay valid while the task may use it
+ * @param  prio: SUT_PRIO_HIGH, SUT_PRIO_NORMAL or SUT_PRIO_LOW
+ * @retval The handle of the task for sut_join(), 0 for an invalid priority
+ */
+sut_task_t sut_create_prio(sut_task_arg_f fn, void *arg, int prio) {
+    if (prio < 0 || prio >= SUT_NUM_PRIO) {
+        return 0;
+    }
+    return create_task(NULL, fn, arg, NULL, task_stack_size, prio);
+}
+
+/**
+ * @brief  Create a task running fn(arg) on a stack of its own size
+ * @note   The size is rounded up to whole pages. A stack of the default size comes from the task
+ *         pool, any other is mapped for the task and unmapped when it exits
+ * @param  fn: The task needed to be excuted
+ * @param  *arg: Its argument, it must stay valid while the task may use it
+ * @param  stack_size: The stack size in bytes, 0 for the default
+ * @retval The handle of the task for sut_join(), never 0
+ */
+sut_task_t sut_create_stack(sut_task_arg_f fn, void *arg, size_t stack_size) {
+    size_t size = stack_size == 0 ? task_stack_size : round_stack_size(stack_size);
+
+    return create_task(NULL, fn, arg, NULL, size, SUT_PRIO_NORMAL);
+}
+
+/**
+ * @brief  Create a task running fn(arg) whose return value is kept in the future
+ * @note   The future is owned by the caller and must outlive the task
+ * @param  *future: Where the handle and then the result of the task are kept
+ * @param  fn: The task needed to be excuted
+ * @param  *arg: Its argument, it must stay valid while the task may use it
+ * @retval The handle of the task, never 0
+ */
+sut_task_t sut_create_future(sut_future *future, sut_task_arg_f fn, void *arg) {
+    future->result = NULL;
+    future->task = create_task(NULL, fn, arg, &future->result, task_stack_size, SUT_PRIO_NORMAL);
+    return future->task;
+}
+
+/**
+ * @brief  Wait for the task of the future and get what it returned
+ * @note   NULL if the task left through sut_exit() instead of returning
+ * @param  *future: The future given to sut_create_future()
+ * @retval The return value of the task
+ */
+void *sut_future_get(sut_future *future) {
+    sut_join(future->task);
+    return future->result;
+}
+
+/**
+ * @brief  Record the joining task on the task it waits for, the park_f of sut_join()
+ * @note
+ * @param  *joiner: The taskdesc of the joining task
+ * @param  *arg: The id of the task to join
+ * @retval Whether that task is still alive, otherwise the joiner goes on at once
+ */
+bool park_on_join(taskdesc *joiner, void *arg) {
+    pthread_mutex_lock(&live_tasks_lock);
+    taskdesc *target = find_live_task(*(sut_task_t *)arg);
+    if (target != NULL) {
+        queue_insert_tail(&target->joiners, &joiner->entry);
+    }
+    pthread_mutex_unlock(&live_tasks_lock);
+
+    return target != NULL;
+}
+
+/**
+ * @brief  Wait until the task exits
+ * @note   A task is parked, not its C_EXEC. Outside of SUT the thread sleeps on join_event
+ * @param  task: The handle sut_create() returned
+ * @retval Whether the task exited, false for an invalid handle or a task joining itself
+ */
+bool sut_join(sut_task_t task) {
+    taskdesc *self = get_running_task();
+    if (task == 0 || task > atomic_load(&num_of_task_ids) || (self != NULL && self->id == task)) {
+        return false;
+    }
+
+    if (self != NULL) {
+        preempt_disable(self);
+        park_task(park_on_join, &task);
+        preempt_enable(self);
+        return true;
+    }
+
+    while (true) {
+        unsigned int epoch = eventcount_prepare(&join_event);
+
+        pthread_mutex_lock(&live_tasks_lock);
+        bool is_alive = find_live_task(task) != NULL;
+        pthread_mutex_unlock(&live_tasks_lock);
+
+        if (!is_alive) {
+            eventcount_cancel(&join_event);
+            return true;
+        }
+        eventcount_wait(&join_event, epoch, UINT64_MAX);
+    }
+}
+
+/**
+ * @brief  stop the task and move the task to the tail of the ready_queue
+ * @note
+ * @retval None
+ */
+void sut_yield() {
+    taskdesc *task = get_running_task();
+
+    preempt_disable(task);
+    switch_to_parent(PENDING_READY);
+    preempt_enable(task);
+}
+
+/**
+ * @brief  Record the task on the timers of its C_EXEC, the park_f of sut_sleep()
+ * @note
+ * @param  *task: The taskdesc of the sleeping task
+ * @param  *arg: The deadline in nanoseconds on CLOCK_MONOTONIC
+ * @retval Whether the deadline is still ahead, otherwise the task goes on at once
+ */
+bool park_on_sleep(taskdesc *task, void *arg) {
+    threaddesc *self = task->executor;
+
+    // Catch the wheel up first, it is left behind while no task sleeps
+    timer_wheel_advance(&self->timers, clock_ns() >> TIMER_TICK_BITS, wake_sleeping_task, self);
+
+    task->timer.expiry = ns_to_tick(*(uint64_t *)arg);
+    task->timer.data = task;
+    return timer_wheel_add(&self->timers, &task->timer);
+}
+
+/**
+ * @brief  Sleep for at least the given time
+ * @note   A task parks on the timer wheel of its C_EXEC, which runs other tasks meanwhile. The sleep
+ *         ends on a timer tick, and once the C_EXEC gets back to its loop. Outside of a task the
+ *         thread sleeps
+ * @param  ns: The time to sleep in nanoseconds
+ * @retval None
+ */
+void sut_sleep(unsigned long ns) {
+    taskdesc *task = get_running_task();
+    if (task == NULL) {
+        struct timespec ts = {ns / 1000000000, ns % 1000000000};
+        nanosleep(&ts, NULL);
+        return;
+    }
+
+    uint64_t deadline_ns = clock_ns() + ns;
+    preempt_disable(task);
+    park_task(park_on_sleep, &deadline_ns);
+    preempt_enable(task);
+}
+
+/**
+ * @brief  Terminate the thread
+ * @note
+ * @retval None
+ */
+void sut_exit() {
+    // Never enabled again, the taskdesc is reset when it is reused
+    preempt_disable(get_running_task());
+
+    pthread_mutex_lock(&num_of_user_thread_lock);
+    bool is_last = --num_of_user_threads == 0 && !is_running;
+    if (is_last) {
+        atomic_store_explicit(&is_runtime_done, true, memory_order_release);
+    }
+    pthread_mutex_unlock(&num_of_user_thread_lock);
+
+    // The parked executors have to see that the runtime is done
+    if (is_last) {
+        eventcount_notify(&ready_event, true);
+        notify_all_IEXEC();
+    }
+
+    // The executor gives the taskdesc back to the pool once the task is switched out
+    threaddesc *parent = get_current_executor();
+    parent->pending_kind = PENDING_EXIT;
+    sut_context_switch(&parent->current_task->context, &parent->parent_thread);
+}
+
+/**
+ * @brief  Open the given file
+ * @note
+ * @param  *dest: the destination directory
+ * @retval int fd: The file descriptor
+ */
+int sut_open(char *dest) {
+    iodesc io = {.op = IO_OPEN, .path = dest};
+
+    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
+    wait_for_io(&io);
+
+    return io.result < 0 ? -1 : io.result;
+}
+
+/**
+ * @brief  Open the given file with O_DIRECT, bypassing the page cache
+ * @note   Its reads and writes need aligned buffers and sizes, e.g. the ones of sut_buf_lease()
+ * @param  *dest: The path of the file
+ * @retval The file description, -1 on failure
+ */
+int sut_open_direct(char *dest) {
+    iodesc io = {.op = IO_OPEN, .path = dest, .open_flags = O_DIRECT};
+
+    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
+    wait_for_io(&io);
+
+    return io.result < 0 ? -1 : io.result;
+}
+
+/**
+ * @brief  Write to a file
+ * @note
+ * @param  fd: The file description
+ * @param  *buf: The buffer for the contents to be saved
+ * @param  size: The size of the contents
+ * @retval None
+ */
+void sut_write(int fd, char *buf, int size) {
+    iodesc io = {.op = IO_WRITE, .fd = fd, .buf = buf, .size = size};
+
+    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
+    wait_for_io(&io);
+}
+
+/**
+ * @brief  Close the given file
+ * @note
+ * @param  fd: The file description
+ * @retval None
+ */
+void sut_close(int fd) {
+    iodesc io = {.op = IO_CLOSE, .fd = fd};
+
+    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
+    wait_for_io(&io);
+}
+
+/**
+ * @brief  Read the given file
+ * @note
+ * @param  fd: The file description
+ * @param  *buf: The buffer for the contents to be saved
+ * @param  size: The size of the contents
+ * @retval
+ */
+char *sut_read(int fd, char *buf, int size) {
+    char *result = NULL;
+    iodesc io = {.op = IO_READ, .fd = fd, .buf = buf, .size = size};
+
+    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
+    wait_for_io(&io);
+
+    if (io.result > 1) {
+        result = "Read Successfully!";
+    }
+
+    return result;
+}
+
+/**
+ * @brief  Read the given file, giving up after a timeout
+ * @note   With io_uring the read is cancelled at the timeout. Otherwise the I_EXEC waits up to the
+ *         timeout for the fd to be readable, which a regular file always is
+ * @param  fd: The file description
+ * @param  *buf: The buffer for the contents to be saved
+ * @param  size: The size of the buffer
+ * @param  timeout_ns: The timeout in nanoseconds, 0 for none
+ * @retval The number of bytes read, SUT_TIMEDOUT at the timeout, -1 on failure
+ */
+int sut_read_timeout(int fd, char *buf, int size, unsigned long timeout_ns) {
+    iodesc io = {.op = IO_READ, .fd = fd, .buf = buf, .size = size, .timeout_ns = timeout_ns};
+
+    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
+    wait_for_io(&io);
+
+    return io.result == -ETIME ? SUT_TIMEDOUT : (io.result < 0 ? -1 : io.result);
+}
+
+/**
+ * @brief  Write to the given file, giving up after a timeout
+ * @note   Like sut_read_timeout(), the contents may be partly written at the timeout
+ * @param  fd: The file description
+ * @param  *buf: The contents
+ * @param  size: The size of the contents
+ * @param  timeout_ns: The timeout in nanoseconds, 0 for none
+ * @retval The number of bytes written, SUT_TIMEDOUT at the timeout, -1 on failure
+ */
+int sut_write_timeout(int fd, char *buf, int size, unsigned long timeout_ns) {
+    iodesc io = {.op = IO_WRITE, .fd = fd, .buf = buf, .size = size, .timeout_ns = timeout_ns};
+
+    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
+    wait_for_io(&io);
+
+    return io.result == -ETIME ? SUT_TIMEDOUT : (io.result < 0 ? -1 : io.result);
+}
+
+/**
+ * @brief  Start reading the given file, without waiting
+ * @note   The reads and writes on one fd still happen in the order they were started
+ * @param  fd: The file description
+ * @param  *buf: The buffer for the contents to be saved, valid until sut_await()
+ * @param  size: The size of the buffer
+ * @retval The token to pass to sut_await(), NULL outside of a task
+ */
+sut_io_t sut_read_async(int fd, char *buf, int size) { return start_async_io(IO_READ, fd, buf, size); }
+
+/**
+ * @brief  Start writing to the given file, without waiting
+ * @note   The reads and writes on one fd still happen in the order they were started
+ * @param  fd: The file description
+ * @param  *buf: The contents to write, valid until sut_await()
+ * @param  size: The size of the contents
+ * @retval The token to pass to sut_await(), NULL outside of a task
+ */
+sut_io_t sut_write_async(int fd, char *buf, int size) { return start_async_io(IO_WRITE, fd, buf, size); }
+
+/**
+ * @brief  Wait for an I/O started by sut_read_async() or sut_write_async()
+ * @note   Parks the task, not its C_EXEC, until the I/O completes. Every token must be awaited
+ *         exactly once, by the task that started it
+ * @param  io: The token
+ * @retval The number of bytes transferred, -1 on failure
+ */
+int sut_await(sut_io_t io) {
+    iodesc *desc = (iodesc *)io;
+    if (desc == NULL) {
+        return -1;
+    }
+
+    if (atomic_load(&desc->waiter) != IO_DONE) {
+        taskdesc *task = get_running_task();
+        preempt_disable(task);
+        park_task(park_on_io, desc);
+        preempt_enable(task);
+    }
+
+    int result = desc->result;
+    free(desc);
+
+    return result < 0 ? -1 : result;
+}
+
+/**
+ * @brief  Record the task on the waiters of the buffer_pool, the park_f of sut_buf_lease()
+ * @note
+ * @param  *task: The taskdesc of the leasing task
+ * @param  *arg: Unused
+ * @retval Whether every buffer is still leased, otherwise the task tries again at once
+ */
+bool park_on_buf(taskdesc *task, void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&buf_pool.lock);
+    bool is_empty = buf_pool.num_of_free_bufs == 0;
+    if (is_empty) {
+        queue_insert_tail(&buf_pool.waiters, &task->entry);
+    }
+    pthread_mutex_unlock(&buf_pool.lock);
+
+    return is_empty;
+}
+
+/**
+ * @brief  Lease a buffer of the buffer_pool
+ * @note   Page-aligned and sut_buf_size() bytes. The I/Os that fit in it skip pinning its pages
+ *         again with io_uring. A task parks while every buffer is leased
+ * @retval The buffer, NULL outside of a task if every buffer is leased
+ */
+char *sut_buf_lease() {
+    taskdesc *self = get_running_task();
+    char *buf = NULL;
+
+    preempt_disable(self);
+    while (buf_pool.num_of_bufs > 0) {
+        pthread_mutex_lock(&buf_pool.lock);
+        if (buf_pool.num_of_free_bufs > 0) {
+            int index = buf_pool.free_bufs[--buf_pool.num_of_free_bufs];
+            buf = buf_pool.bufs + index * buf_pool.buf_size;
+        }
+        pthread_mutex_unlock(&buf_pool.lock);
+
+        if (buf != NULL || self == NULL) {
+            break;
+        }
+        park_task(park_on_buf, NULL);
+    }
+    preempt_enable(self);
+
+    return buf;
+}
+
+/**
+ * @brief  Give a buffer of sut_buf_lease() back, and wake a task waiting for one
+ * @note   No I/O on it may still be in flight
+ * @param  *buf: The buffer
+ * @retval None
+ */
+void sut_buf_release(char *buf) {
+    int index = get_pool_buf_index(buf, 1);
+    if (index < 0) {
+        return;
+    }
+
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    pthread_mutex_lock(&buf_pool.lock);
+    buf_pool.free_bufs[buf_pool.num_of_free_bufs++] = index;
+    struct queue_entry *waiter = queue_pop_head(&buf_pool.waiters);
+    pthread_mutex_unlock(&buf_pool.lock);
+
+    if (waiter != NULL) {
+        unpark_task((taskdesc *)waiter->data);
+    }
+    preempt_enable(self);
+}
+
+/**
+ * @brief  The size of the buffers of sut_buf_lease()
+ */
+int sut_buf_size() { return (int)buf_pool.buf_size; }
+
+/**
+ * @brief  Set up an empty waitlist
+ */
+void waitlist_init(waitlist *list) {
+    atomic_init(&list->num_of_waiters, 0);
+    pthread_mutex_init(&list->lock, NULL);
+    queue_init(&list->tasks);
+}
+
+void waitlist_destroy(waitlist *list) { pthread_mutex_destroy(&list->lock); }
+
+/**
+ * @brief  Record the task on the waitlist unless its condition already changed, the park_f of
+ *         wait_on_waitlist()
+ * @note
+ * @param  *task: The taskdesc of the waiting task
+ * @param  *arg: The waitlist_park
+ * @retval Whether the task still has to wait, otherwise it tries again at once
+ */
+bool park_on_waitlist(taskdesc *task, void *arg) {
+    waitlist_park *park = (waitlist_park *)arg;
+    waitlist *list = park->list;
+
+    pthread_mutex_lock(&list->lock);
+    atomic_fetch_add(&list->num_of_waiters, 1);
+    bool should_wait = park->should_wait(park->arg);
+    if (should_wait) {
+        queue_insert_tail(&list->tasks, &task->entry);
+    } else {
+        atomic_fetch_sub(&list->num_of_waiters, 1);
+    }
+    pthread_mutex_unlock(&list->lock);
+
+    return should_wait;
+}
+
+/**
+ * @brief  Wait on the waitlist while should_wait holds, by parking the task
+ * @note   Outside of a task the thread only yields the CPU. The caller checks its condition again
+ * @param  *self: The running task, NULL outside of a task
+ * @param  *list: The waitlist
+ * @param  should_wait: Checked with the lock held, once the task is counted as a waiter
+ * @param  *arg: The argument of should_wait
+ * @retval None
+ */
+void wait_on_waitlist(taskdesc *self, waitlist *list, should_wait_f should_wait, void *arg) {
+    waitlist_park park = {.list = list, .should_wait = should_wait, .arg = arg};
+
+    if (self != NULL) {
+        park_task(park_on_waitlist, &park);
+    } else {
+        sched_yield();
+    }
+}
+
+/**
+ * @brief  Wake the task waiting the longest on the waitlist, if any
+ * @note   Only takes the lock when some task waits
+ * @param  *list: The waitlist
+ * @retval Whether a task was woken
+ */
+bool waitlist_wake_one(waitlist *list) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&list->num_of_waiters, memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&list->lock);
+    struct queue_entry *waiter = queue_pop_head(&list->tasks);
+    if (waiter != NULL) {
+        atomic_fetch_sub(&list->num_of_waiters, 1);
+    }
+    pthread_mutex_unlock(&list->lock);
+
+    if (waiter != NULL) {
+        unpark_task((taskdesc *)waiter->data);
     }
+    return waiter != NULL;
 }
 
 /**
- * @brief  Free the context given
- * @note
- * @param  *context: The context needed to be free with memory
- * @retval None
+ * @brief  Wake every task waiting on the waitlist
  */
-void free_context(ucontext_t *context) {
-    free(context->uc_stack.ss_sp);
-    free(context);
-}
-
-// ------------------ Main Functions ------------------
-
-void *C_EXEC() {
-    ucontext_t *current_thread = (ucontext_t *)malloc(sizeof(ucontext_t));
+void waitlist_wake_all(waitlist *list) {
+    struct queue waiters;
+    queue_init(&waiters);
 
-    current_thread->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_thread->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_thread->uc_link = 0;
-    current_thread->uc_stack.ss_flags = 0;
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&list->num_of_waiters, memory_order_relaxed) == 0) {
+        return;
+    }
 
-    getcontext(current_thread);
+    pthread_mutex_lock(&list->lock);
+    queue_concat(&waiters, &list->tasks);
+    atomic_store(&list->num_of_waiters, 0);
+    pthread_mutex_unlock(&list->lock);
 
-    threaddesc *current_thread_description = (threaddesc *)malloc(sizeof(threaddesc));
+    struct queue_entry *waiter = queue_pop_head(&waiters);
+    while (waiter != NULL) {
+        unpark_task((taskdesc *)waiter->data);
+        waiter = queue_pop_head(&waiters);
+    }
+}
 
-    current_thread_description->thread_id = get_thread_id();
-    current_thread_description->parent_thread = current_thread;
+/**
+ * @brief  The sequence of the cell of a position
+ */
+atomic_size_t *chan_cell_sequence(struct sut_chan *chan, size_t pos) {
+    return (atomic_size_t *)(chan->cells + (pos & chan->mask) * chan->cell_size);
+}
 
-    pthread_mutex_lock(&num_of_thread_lock);
-    pthread_mutex_lock(&thread_array_lock);
-    thread_array[num_of_thread] = current_thread_description;
-    num_of_thread++;
-    pthread_mutex_unlock(&thread_array_lock);
-    pthread_mutex_unlock(&num_of_thread_lock);
+/**
+ * @brief  Copy an element into the channel, without waiting
+ * @retval Whether there was room
+ */
+bool chan_try_send(struct sut_chan *chan, const void *elem) {
+    atomic_size_t *sequence;
+    size_t pos = atomic_load_explicit(&chan->send_pos, memory_order_relaxed);
 
     while (true) {
-        if (!is_running && !num_of_user_threads) {
-            pthread_exit(NULL);
+        sequence = chan_cell_sequence(chan, pos);
+        intptr_t dif = (intptr_t)atomic_load_explicit(sequence, memory_order_acquire) - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&chan->send_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&chan->send_pos, memory_order_relaxed);
         }
+    }
 
-        // Get the next queue_entry to be run
-        pthread_mutex_lock(&ready_queue_lock);
-        struct queue_entry *next_task = queue_pop_head(&ready_queue);
-        pthread_mutex_unlock(&ready_queue_lock);
+    memcpy(sequence + 1, elem, chan->elem_size);
+    atomic_store_explicit(sequence, pos + 1, memory_order_release);
+    return true;
+}
 
-        if (next_task != NULL) {
-            ucontext_t *next_context = (ucontext_t *)next_task->data;
-            next_context->uc_link = current_thread;
-            swapcontext(current_thread, next_context);
+/**
+ * @brief  Copy the oldest element out of the channel, without waiting
+ * @retval Whether there was one
+ */
+bool chan_try_recv(struct sut_chan *chan, void *elem) {
+    atomic_size_t *sequence;
+    size_t pos = atomic_load_explicit(&chan->recv_pos, memory_order_relaxed);
 
-            // Store the queue entrys created for memory free later
-            pthread_mutex_lock(&entry_created_queue_lock);
-            queue_insert_tail(&entry_created_queue, next_task);
-            pthread_mutex_unlock(&entry_created_queue_lock);
+    while (true) {
+        sequence = chan_cell_sequence(chan, pos);
+        intptr_t dif = (intptr_t)atomic_load_explicit(sequence, memory_order_acquire) - (intptr_t)(pos + 1);
 
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&chan->recv_pos, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return false;
         } else {
-            usleep(100); // While the ready_queue is empty, sleep for a while to save CPU
+            pos = atomic_load_explicit(&chan->recv_pos, memory_order_relaxed);
         }
     }
-}
 
-void *I_EXEC() {
-    ucontext_t *current_thread = (ucontext_t *)malloc(sizeof(ucontext_t));
+    memcpy(elem, sequence + 1, chan->elem_size);
+    atomic_store_explicit(sequence, pos + chan->mask + 1, memory_order_release);
+    return true;
+}
 
-    current_thread->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_thread->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_thread->uc_link = 0;
-    current_thread->uc_stack.ss_flags = 0;
+/**
+ * @brief  Whether a sender has to wait, the should_wait_f of senders
+ */
+bool should_send_wait(void *arg) {
+    struct sut_chan *chan = (struct sut_chan *)arg;
+    size_t pos = atomic_load(&chan->send_pos);
+    intptr_t dif = (intptr_t)(atomic_load(chan_cell_sequence(chan, pos)) - pos);
 
-    getcontext(current_thread);
+    return !atomic_load(&chan->is_closed) && dif < 0;
+}
 
-    threaddesc *current_thread_description = (threaddesc *)malloc(sizeof(threaddesc));
+/**
+ * @brief  Whether a receiver has to wait, the should_wait_f of receivers
+ */
+bool should_recv_wait(void *arg) {
+    struct sut_chan *chan = (struct sut_chan *)arg;
+    size_t pos = atomic_load(&chan->recv_pos);
+    intptr_t dif = (intptr_t)(atomic_load(chan_cell_sequence(chan, pos)) - (pos + 1));
 
-    current_thread_description->thread_id = get_thread_id();
-    current_thread_description->parent_thread = current_thread;
+    return !atomic_load(&chan->is_closed) && dif < 0;
+}
 
-    pthread_mutex_lock(&num_of_thread_lock);
-    pthread_mutex_lock(&thread_array_lock);
-    thread_array[num_of_thread] = current_thread_description;
-    num_of_thread++;
-    pthread_mutex_unlock(&thread_array_lock);
-    pthread_mutex_unlock(&num_of_thread_lock);
+/**
+ * @brief  Create a bounded channel
+ * @note   The capacity is rounded up to a power of two, at least 2
+ * @param  elem_size: The size of an element, copied in and out
+ * @param  capacity: How many elements it holds before a sender waits
+ * @retval The channel, NULL if elem_size is 0
+ */
+sut_chan_t sut_chan_create(size_t elem_size, size_t capacity) {
+    if (elem_size == 0) {
+        return NULL;
+    }
 
-    while (true) {
-        if (!is_running && !num_of_user_threads) {
-            pthread_exit(NULL);
-        }
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
 
-        // Get the next queue_entry to be run
-        pthread_mutex_lock(&wait_queue_lock);
-        struct queue_entry *next_task = queue_pop_head(&wait_queue);
-        pthread_mutex_unlock(&wait_queue_lock);
+    struct sut_chan *chan = (struct sut_chan *)calloc(1, sizeof(struct sut_chan));
+    chan->elem_size = elem_size;
+    chan->cell_size = (sizeof(atomic_size_t) + elem_size + 7) / 8 * 8;
+    chan->mask = size - 1;
+    chan->cells = (char *)malloc(size * chan->cell_size);
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(chan_cell_sequence(chan, i), i);
+    }
+    atomic_init(&chan->send_pos, 0);
+    atomic_init(&chan->recv_pos, 0);
+    atomic_init(&chan->is_closed, false);
+    waitlist_init(&chan->senders);
+    waitlist_init(&chan->receivers);
 
-        if (next_task != NULL) {
-            ucontext_t *next_context = (ucontext_t *)next_task->data;
-            next_context->uc_link = current_thread;
-            swapcontext(current_thread, next_context);
+    return chan;
+}
 
-            // Store the queue entrys created for memory free later
-            pthread_mutex_lock(&entry_created_queue_lock);
-            queue_insert_tail(&entry_created_queue, next_task);
-            pthread_mutex_unlock(&entry_created_queue_lock);
+/**
+ * @brief  Send an element, waiting while the channel is full
+ * @note   A task parks, not its C_EXEC
+ * @param  chan: The channel
+ * @param  *elem: The element, copied
+ * @retval Whether it was sent, false once the channel is closed
+ */
+bool sut_chan_send(sut_chan_t chan, const void *elem) {
+    taskdesc *self = get_running_task();
+    bool is_sent = false;
 
-        } else {
-            usleep(100); // While the wait_queue is empty, sleep for a while to save CPU
+    preempt_disable(self);
+    while (!atomic_load(&chan->is_closed)) {
+        if ((is_sent = chan_try_send(chan, elem))) {
+            waitlist_wake_one(&chan->receivers);
+            break;
         }
+        wait_on_waitlist(self, &chan->senders, should_send_wait, chan);
     }
+    preempt_enable(self);
+
+    return is_sent;
 }
 
 /**
- * @brief  Initialize the queues, CEXEC and IEXEC
- * @note
- * @retval None
+ * @brief  Receive the oldest element, waiting while the channel is empty
+ * @note   A task parks, not its C_EXEC. The elements sent before sut_chan_close() are still received
+ * @param  chan: The channel
+ * @param  *elem: Where the element is copied
+ * @retval Whether an element was received, false once the channel is closed and empty
  */
-void sut_init() {
-    num_of_thread = 0;
-    num_of_user_threads = 0;
-    is_running = true;
-    ready_queue = queue_create();
-    wait_queue = queue_create();
-
-    // Initialize the queues
-    queue_init(&ready_queue);
-    queue_init(&wait_queue);
-    queue_init(&entry_created_queue);
-
-    // Initilize the mutex locks
-    pthread_mutex_init(&num_of_thread_lock, NULL);
-    pthread_mutex_init(&ready_queue_lock, NULL);
-    pthread_mutex_init(&wait_queue_lock, NULL);
-    pthread_mutex_init(&thread_array_lock, NULL);
-    pthread_mutex_init(&num_of_user_thread_lock, NULL);
-    pthread_mutex_init(&entry_created_queue_lock, NULL);
-
-    if (num_of_CEXEC == 1) {
-        CEXEC = (pthread_t *)malloc(sizeof(pthread_t));
-        IEXEC = (pthread_t *)malloc(sizeof(pthread_t));
+bool sut_chan_recv(sut_chan_t chan, void *elem) {
+    taskdesc *self = get_running_task();
+    bool is_received = false;
 
-        pthread_create(CEXEC, NULL, C_EXEC, NULL);
-        pthread_create(IEXEC, NULL, I_EXEC, NULL);
-    } else {
-        CEXEC_1 = (pthread_t *)malloc(sizeof(pthread_t));
-        CEXEC_2 = (pthread_t *)malloc(sizeof(pthread_t));
-        IEXEC = (pthread_t *)malloc(sizeof(pthread_t));
-
-        pthread_create(CEXEC_1, NULL, C_EXEC, NULL);
-        pthread_create(CEXEC_2, NULL, C_EXEC, NULL);
-        pthread_create(IEXEC, NULL, I_EXEC, NULL);
+    preempt_disable(self);
+    while (true) {
+        bool is_closed = atomic_load(&chan->is_closed);
+        if ((is_received = chan_try_recv(chan, elem))) {
+            waitlist_wake_one(&chan->senders);
+            break;
+        }
+        if (is_closed) {
+            break;
+        }
+        wait_on_waitlist(self, &chan->receivers, should_recv_wait, chan);
     }
+    preempt_enable(self);
+
+    return is_received;
 }
 
 /**
- * @brief  add the task into the ready_queue
- * @note
- * @param  fn: The task needed to be excuted
- * @retval
+ * @brief  Send an element if the channel has room now
+ * @retval Whether it was sent
  */
-bool sut_create(sut_task_f fn) {
-    pthread_mutex_lock(&num_of_user_thread_lock);
-    num_of_user_threads++;
-    pthread_mutex_unlock(&num_of_user_thread_lock);
-
-    // Create the context for coming task
-    ucontext_t *new_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+bool sut_chan_try_send(sut_chan_t chan, const void *elem) {
+    taskdesc *self = get_running_task();
+    bool is_sent = false;
 
-    new_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    new_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    new_context->uc_link = 0;
-    new_context->uc_stack.ss_flags = 0;
+    preempt_disable(self);
+    if (!atomic_load(&chan->is_closed) && (is_sent = chan_try_send(chan, elem))) {
+        waitlist_wake_one(&chan->receivers);
+    }
+    preempt_enable(self);
 
-    getcontext(new_context);
-    makecontext(new_context, fn, 0);
+    return is_sent;
+}
 
-    // store the current context into the ready queue
-    struct queue_entry *new_task = queue_new_node(new_context);
+/**
+ * @brief  Receive the oldest element if there is one now
+ * @retval Whether an element was received
+ */
+bool sut_chan_try_recv(sut_chan_t chan, void *elem) {
+    taskdesc *self = get_running_task();
 
-    pthread_mutex_lock(&ready_queue_lock);
-    queue_insert_tail(&ready_queue, new_task);
-    pthread_mutex_unlock(&ready_queue_lock);
+    preempt_disable(self);
+    bool is_received = chan_try_recv(chan, elem);
+    if (is_received) {
+        waitlist_wake_one(&chan->senders);
+    }
+    preempt_enable(self);
 
-    return true;
+    return is_received;
 }
 
 /**
- * @brief  stop the task and move the task to the tail of the ready_queue
- * @note
+ * @brief  Close the channel, the sends fail from now on and the receives once it is empty
+ * @note   Wakes every waiting task
+ * @param  chan: The channel
  * @retval None
  */
-void sut_yield() {
-    ucontext_t *current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+void sut_chan_close(sut_chan_t chan) {
+    taskdesc *self = get_running_task();
 
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
-
-    getcontext(current_context);
-
-    ucontext_t *parent_context = get_parent_thread(get_thread_id());
+    preempt_disable(self);
+    atomic_store(&chan->is_closed, true);
+    waitlist_wake_all(&chan->senders);
+    waitlist_wake_all(&chan->receivers);
+    preempt_enable(self);
+}
 
-    struct queue_entry *new_task = queue_new_node(current_context);
+/**
+ * @brief  Free the channel
+ * @note   No task may still use it
+ */
+void sut_chan_destroy(sut_chan_t chan) {
+    waitlist_destroy(&chan->senders);
+    waitlist_destroy(&chan->receivers);
+    free(chan->cells);
+    free(chan);
+}
 
-    pthread_mutex_lock(&ready_queue_lock);
-    queue_insert_tail(&ready_queue, new_task);
-    pthread_mutex_unlock(&ready_queue_lock);
+/**
+ * @brief  Whether a task locking the mutex has to wait, the should_wait_f of its waiters
+ * @note   Only while it is marked as waited for, otherwise the unlock would not wake anyone
+ */
+bool should_mutex_wait(void *arg) { return atomic_load(&((struct sut_mutex *)arg)->state) == 2; }
 
-    swapcontext(current_context, parent_context);
+/**
+ * @brief  Create a mutex, unlocked
+ */
+sut_mutex_t sut_mutex_create() {
+    struct sut_mutex *mutex = (struct sut_mutex *)malloc(sizeof(struct sut_mutex));
+    atomic_init(&mutex->state, 0);
+    waitlist_init(&mutex->waiters);
+    return mutex;
 }
 
 /**
- * @brief  Terminate the thread
- * @note
+ * @brief  Lock the mutex, waiting while another task holds it
+ * @note   A task parks, not its C_EXEC, and goes back to the ready queue once the mutex is unlocked.
+ *         A task may hold it across sut_yield() and the I/Os
+ * @param  mutex: The mutex
  * @retval None
  */
-void sut_exit() {
-    pthread_mutex_lock(&num_of_user_thread_lock);
-    num_of_user_threads--;
-    pthread_mutex_unlock(&num_of_user_thread_lock);
+void sut_mutex_lock(sut_mutex_t mutex) {
+    int unlocked = 0;
+    if (atomic_compare_exchange_strong(&mutex->state, &unlocked, 1)) {
+        return;
+    }
 
-    setcontext(get_parent_thread(get_thread_id()));
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    while (atomic_exchange(&mutex->state, 2) != 0) {
+        wait_on_waitlist(self, &mutex->waiters, should_mutex_wait, mutex);
+    }
+    preempt_enable(self);
 }
 
 /**
- * @brief  Open the given file
- * @note
- * @param  *dest: the destination directory
- * @retval int fd: The file descriptor
+ * @brief  Lock the mutex if no task holds it
+ * @retval Whether it was locked
  */
-int sut_open(char *dest) {
-    int fd = -1;
+bool sut_mutex_trylock(sut_mutex_t mutex) {
+    int unlocked = 0;
+    return atomic_compare_exchange_strong(&mutex->state, &unlocked, 1);
+}
 
-    ucontext_t *current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+/**
+ * @brief  Unlock the mutex, and wake a task waiting for it
+ * @note   The woken task competes again with the tasks locking it meanwhile
+ * @param  mutex: The mutex, held by the caller
+ * @retval None
+ */
+void sut_mutex_unlock(sut_mutex_t mutex) {
+    if (atomic_exchange(&mutex->state, 0) != 2) {
+        return;
+    }
 
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    waitlist_wake_one(&mutex->waiters);
+    preempt_enable(self);
+}
 
-    getcontext(current_context);
+/**
+ * @brief  Free the mutex
+ * @note   No task may still use it
+ */
+void sut_mutex_destroy(sut_mutex_t mutex) {
+    waitlist_destroy(&mutex->waiters);
+    free(mutex);
+}
 
-    ucontext_t *parent_context = get_parent_thread(get_thread_id());
+/**
+ * @brief  Unlock the mutex of sut_cond_wait(), once the task is recorded on the condition variable
+ * @note   The should_wait_f of its waiters, a signal after the unlock always finds the task
+ */
+bool unlock_for_cond(void *arg) {
+    sut_mutex_unlock((sut_mutex_t)arg);
+    return true;
+}
 
-    // store the current context into the wait queue
-    struct queue_entry *temp_entry = queue_new_node(current_context);
+/**
+ * @brief  Create a condition variable
+ */
+sut_cond_t sut_cond_create() {
+    struct sut_cond *cond = (struct sut_cond *)malloc(sizeof(struct sut_cond));
+    waitlist_init(&cond->waiters);
+    return cond;
+}
 
-    pthread_mutex_lock(&wait_queue_lock);
-    queue_insert_tail(&wait_queue, temp_entry);
-    pthread_mutex_unlock(&wait_queue_lock);
+/**
+ * @brief  Unlock the mutex and wait for a signal, then lock it again
+ * @note   A task parks, not its C_EXEC. The condition may not hold any more once it returns, so
+ *         wait in a loop. Outside of a task it returns at once, after yielding the CPU
+ * @param  cond: The condition variable
+ * @param  mutex: The mutex, held by the caller
+ * @retval None
+ */
+void sut_cond_wait(sut_cond_t cond, sut_mutex_t mutex) {
+    taskdesc *self = get_running_task();
 
-    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
-    swapcontext(current_context, parent_context);
+    preempt_disable(self);
+    if (self != NULL) {
+        wait_on_waitlist(self, &cond->waiters, unlock_for_cond, mutex);
+    } else {
+        sut_mutex_unlock(mutex);
+        sched_yield();
+    }
+    preempt_enable(self);
 
-    // I_EXEC runs this
-    fd = open(dest, O_RDWR, 0777);
+    sut_mutex_lock(mutex);
+}
 
-    // Put it back to ready_queue for C_EXEC and give the control to I_EXEC
-    current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+/**
+ * @brief  Wake the task waiting the longest on the condition variable, if any
+ */
+void sut_cond_signal(sut_cond_t cond) {
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    waitlist_wake_one(&cond->waiters);
+    preempt_enable(self);
+}
 
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
+/**
+ * @brief  Wake every task waiting on the condition variable
+ */
+void sut_cond_broadcast(sut_cond_t cond) {
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    waitlist_wake_all(&cond->waiters);
+    preempt_enable(self);
+}
 
-    parent_context = get_parent_thread(get_thread_id());
+/**
+ * @brief  Free the condition variable
+ * @note   No task may still wait on it
+ */
+void sut_cond_destroy(sut_cond_t cond) {
+    waitlist_destroy(&cond->waiters);
+    free(cond);
+}
 
-    temp_entry = queue_new_node(current_context);
+/**
+ * @brief  Whether a task has to wait on the semaphore, the should_wait_f of its waiters
+ */
+bool should_sem_wait(void *arg) { return atomic_load(&((struct sut_sem *)arg)->value) <= 0; }
 
-    pthread_mutex_lock(&ready_queue_lock);
-    queue_insert_tail(&ready_queue, temp_entry);
-    pthread_mutex_unlock(&ready_queue_lock);
-    swapcontext(current_context, parent_context);
+/**
+ * @brief  Create a counting semaphore
+ * @param  value: The initial value
+ */
+sut_sem_t sut_sem_create(unsigned int value) {
+    struct sut_sem *sem = (struct sut_sem *)malloc(sizeof(struct sut_sem));
+    atomic_init(&sem->value, value);
+    waitlist_init(&sem->waiters);
+    return sem;
+}
 
-    return fd;
+/**
+ * @brief  Decrement the value if it is positive
+ * @retval Whether it was decremented
+ */
+bool sut_sem_trywait(sut_sem_t sem) {
+    long value = atomic_load(&sem->value);
+    while (value > 0) {
+        if (atomic_compare_exchange_weak(&sem->value, &value, value - 1)) {
+            return true;
+        }
+    }
+    return false;
 }
 
 /**
- * @brief  Write to a file
- * @note
- * @param  fd: The file description
- * @param  *buf: The buffer for the contents to be saved
- * @param  size: The size of the contents
+ * @brief  Decrement the value, waiting while it is 0
+ * @note   A task parks, not its C_EXEC
+ * @param  sem: The semaphore
  * @retval None
  */
-void sut_write(int fd, char *buf, int size) {
-    ucontext_t *current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
-
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
-
-    getcontext(current_context);
-
-    ucontext_t *parent_context = get_parent_thread(get_thread_id());
-
-    // store the current context into the wait queue
-    struct queue_entry *temp_entry = queue_new_node(current_context);
-
-    pthread_mutex_lock(&wait_queue_lock);
-    queue_insert_tail(&wait_queue, temp_entry);
-    pthread_mutex_unlock(&wait_queue_lock);
-
-    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
-    swapcontext(current_context, parent_context);
-
-    // I_EXEC runs this
-    write(fd, buf, size);
-
-    // Put it back to ready_queue for C_EXEC and give the control to I_EXEC
-    current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+void sut_sem_wait(sut_sem_t sem) {
+    if (sut_sem_trywait(sem)) {
+        return;
+    }
 
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    while (!sut_sem_trywait(sem)) {
+        wait_on_waitlist(self, &sem->waiters, should_sem_wait, sem);
+    }
+    preempt_enable(self);
+}
 
-    parent_context = get_parent_thread(get_thread_id());
+/**
+ * @brief  Increment the value, and wake a task waiting for it
+ */
+void sut_sem_post(sut_sem_t sem) {
+    atomic_fetch_add(&sem->value, 1);
 
-    temp_entry = queue_new_node(current_context);
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    waitlist_wake_one(&sem->waiters);
+    preempt_enable(self);
+}
 
-    pthread_mutex_lock(&ready_queue_lock);
-    queue_insert_tail(&ready_queue, temp_entry);
-    pthread_mutex_unlock(&ready_queue_lock);
-    swapcontext(current_context, parent_context);
+/**
+ * @brief  Free the semaphore
+ * @note   No task may still wait on it
+ */
+void sut_sem_destroy(sut_sem_t sem) {
+    waitlist_destroy(&sem->waiters);
+    free(sem);
 }
 
 /**
- * @brief  Close the given file
+ * @brief  Get the parking counters summed over all the executors
  * @note
- * @param  fd: The file description
+ * @param  *stats: Where the counters are written
  * @retval None
  */
-void sut_close(int fd) {
-    ucontext_t *current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
-
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
+void sut_get_idle_stats(struct sut_idle_stats *stats) {
+    stats->parks = 0;
+    stats->wakeups = 0;
+    stats->spurious_wakeups = 0;
+    stats->timeouts = 0;
 
-    getcontext(current_context);
+    for (int i = 0; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        stats->parks += atomic_load_explicit(&thread_array[i]->num_of_parks, memory_order_relaxed);
+        stats->wakeups += atomic_load_explicit(&thread_array[i]->num_of_wakeups, memory_order_relaxed);
+        stats->spurious_wakeups +=
+            atomic_load_explicit(&thread_array[i]->num_of_spurious_wakeups, memory_order_relaxed);
+        stats->timeouts += atomic_load_explicit(&thread_array[i]->num_of_timeouts, memory_order_relaxed);
+    }
+}
 
-    ucontext_t *parent_context = get_parent_thread(get_thread_id());
+/**
+ * @brief  Get the name of the context switch SUT was built with
+ * @note   "x86-64" with -DSUT_FAST_CONTEXT on x86-64, "ucontext" otherwise
+ * @retval The name of the backend
+ */
+const char *sut_context_backend() { return SUT_CONTEXT_BACKEND; }
 
-    // store the current context into the wait queue
-    struct queue_entry *temp_entry = queue_new_node(current_context);
+_Static_assert(SUT_HISTOGRAM_BUCKETS == HISTOGRAM_BUCKETS, "sut_histogram must match histogram");
 
-    pthread_mutex_lock(&wait_queue_lock);
-    queue_insert_tail(&wait_queue, temp_entry);
-    pthread_mutex_unlock(&wait_queue_lock);
+/**
+ * @brief  Add a histogram of an executor into a snapshot
+ */
+void merge_histogram(struct sut_histogram *to, struct histogram *from) {
+    to->count += atomic_load_explicit(&from->count, memory_order_relaxed);
+    to->sum += atomic_load_explicit(&from->sum, memory_order_relaxed);
+    unsigned long max = atomic_load_explicit(&from->max, memory_order_relaxed);
+    if (max > to->max) {
+        to->max = max;
+    }
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        to->buckets[i] += atomic_load_explicit(&from->buckets[i], memory_order_relaxed);
+    }
+}
 
-    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
-    swapcontext(current_context, parent_context);
+/**
+ * @brief  Take a snapshot of the counters, queue depths and histograms of the scheduler
+ * @note   Any thread, between sut_init() and sut_shutdown(). The counters are read one by one
+ *         while the executors run, so they may not add up exactly
+ * @retval The snapshot, to be freed with free()
+ */
+struct sut_stats *sut_stats() {
+    struct sut_stats *stats = (struct sut_stats *)calloc(
+        1, sizeof(struct sut_stats) + (num_of_CEXEC + num_of_IEXEC) * sizeof(struct sut_executor_stats));
 
-    // I_EXEC runs this
-    close(fd);
+    for (int i = 0; i < SUT_NUM_PRIO; i++) {
+        stats->ready_queue_depth += shared_queue_size(&ready_queue[i]);
+    }
+    taskdesc *self = get_running_task();
+    preempt_disable(self);
+    pthread_mutex_lock(&live_tasks_lock);
+    stats->live_tasks = num_of_live_tasks;
+    pthread_mutex_unlock(&live_tasks_lock);
+    preempt_enable(self);
 
-    // Put it back to ready_queue for C_EXEC and give the control to I_EXEC
-    current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+    stats->num_of_executors = num_of_CEXEC + num_of_IEXEC;
+    for (int i = 0; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        threaddesc *desc = thread_array[i];
+        struct sut_executor_stats *executor = &stats->executors[i];
 
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
+        executor->is_io = !is_CEXEC(desc);
+        executor->switches = atomic_load_explicit(&desc->num_of_switches, memory_order_relaxed);
+        executor->preemptions = atomic_load_explicit(&desc->num_of_preemptions, memory_order_relaxed);
+        executor->steals = atomic_load_explicit(&desc->num_of_steals, memory_order_relaxed);
+        executor->ios = atomic_load_explicit(&desc->num_of_ios, memory_order_relaxed);
+        executor->parks = atomic_load_explicit(&desc->num_of_parks, memory_order_relaxed);
+        executor->wakeups = atomic_load_explicit(&desc->num_of_wakeups, memory_order_relaxed);
+        executor->spurious_wakeups =
+            atomic_load_explicit(&desc->num_of_spurious_wakeups, memory_order_relaxed);
+        executor->timeouts = atomic_load_explicit(&desc->num_of_timeouts, memory_order_relaxed);
+        if (executor->is_io) {
+            executor->queue_depth = __atomic_load_n(&desc->num_of_inflight, __ATOMIC_RELAXED);
+            stats->wait_queue_depth += shared_queue_size(&desc->wait_queue);
+        } else {
+            for (int j = 0; j < SUT_NUM_PRIO; j++) {
+                executor->queue_depth += steal_queue_size(&desc->local_queue[j]);
+            }
+        }
 
-    parent_context = get_parent_thread(get_thread_id());
+        merge_histogram(&stats->queue_wait, &desc->queue_wait);
+        merge_histogram(&stats->run_slice, &desc->run_slice);
+        merge_histogram(&stats->io_turnaround, &desc->io_turnaround);
+    }
 
-    temp_entry = queue_new_node(current_context);
-    pthread_mutex_lock(&ready_queue_lock);
-    queue_insert_tail(&ready_queue, temp_entry);
-    pthread_mutex_unlock(&ready_queue_lock);
-    swapcontext(current_context, parent_context);
+    return stats;
 }
 
 /**
- * @brief  Read the given file
- * @note
- * @param  fd: The file description
- * @param  *buf: The buffer for the contents to be saved
- * @param  size: The size of the contents
- * @retval
+ * @brief  Get a percentile of a histogram
+ * @note   The highest value of the bucket it falls in, so at most 12.5% above the exact one
+ * @param  *histogram: The histogram
+ * @param  percentile: Between 0 and 100
+ * @retval The value in nanoseconds, 0 for an empty histogram
  */
-char *sut_read(int fd, char *buf, int size) {
-    char *result = NULL;
-    int out;
+unsigned long sut_histogram_percentile(const struct sut_histogram *histogram, double percentile) {
+    if (histogram->count == 0) {
+        return 0;
+    }
+
+    unsigned long rank = (unsigned long)(percentile / 100 * histogram->count + 0.5);
+    unsigned long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank && seen > 0) {
+            unsigned long high = i + 1 < HISTOGRAM_BUCKETS ? histogram_bucket_low(i + 1) - 1 : ~0UL;
+            return high < histogram->max ? high : histogram->max;
+        }
+    }
+    return histogram->max;
+}
 
-    ucontext_t *current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+/**
+ * @brief  Print a histogram on one line of stderr
+ */
+void print_histogram(const char *name, const struct sut_histogram *histogram) {
+    fprintf(stderr, "  %-14s count=%lu mean_ns=%lu p50_ns=%lu p90_ns=%lu p99_ns=%lu max_ns=%lu\n",
+            name, histogram->count, histogram->count ? histogram->sum / histogram->count : 0,
+            sut_histogram_percentile(histogram, 50), sut_histogram_percentile(histogram, 90),
+            sut_histogram_percentile(histogram, 99), histogram->max);
+}
 
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
+/**
+ * @brief  Print a snapshot taken by sut_stats() to stderr
+ * @note
+ * @param  *stats: The snapshot
+ * @retval None
+ */
+void sut_stats_print(const struct sut_stats *stats) {
+    fprintf(stderr, "SUT stats: ready_queue=%ld wait_queue=%ld live_tasks=%ld\n",
+            stats->ready_queue_depth, stats->wait_queue_depth, stats->live_tasks);
 
-    getcontext(current_context);
+    for (int i = 0; i < stats->num_of_executors; i++) {
+        const struct sut_executor_stats *executor = &stats->executors[i];
+        fprintf(stderr,
+                "  %s %d: switches=%lu preemptions=%lu steals=%lu ios=%lu parks=%lu wakeups=%lu "
+                "spurious_wakeups=%lu timeouts=%lu queue_depth=%ld\n",
+                executor->is_io ? "I_EXEC" : "C_EXEC", i, executor->switches, executor->preemptions,
+                executor->steals, executor->ios, executor->parks, executor->wakeups,
+                executor->spurious_wakeups, executor->timeouts, executor->queue_depth);
+    }
 
-    ucontext_t *parent_context = get_parent_thread(get_thread_id());
+    print_histogram("queue_wait", &stats->queue_wait);
+    print_histogram("run_slice", &stats->run_slice);
+    print_histogram("io_turnaround", &stats->io_turnaround);
+}
 
-    // store the current context into the wait queue
-    struct queue_entry *temp_entry = queue_new_node(current_context);
+/**
+ * @brief  Keep the calling task from being preempted until sut_preempt_enable()
+ * @note   The calls nest. Does nothing outside of a task or without SUT_QUANTUM_US
+ * @retval None
+ */
+void sut_preempt_disable() { preempt_disable(get_running_task()); }
 
-    pthread_mutex_lock(&wait_queue_lock);
-    queue_insert_tail(&wait_queue, temp_entry);
-    pthread_mutex_unlock(&wait_queue_lock);
+/**
+ * @brief  Allow the calling task to be preempted again
+ * @note   Yields if its time slice ran out in between
+ * @retval None
+ */
+void sut_preempt_enable() { preempt_enable(get_running_task()); }
 
-    // Give the control to the parent C_EXEC, and leave the rest to I_EXEC
-    swapcontext(current_context, parent_context);
+/**
+ * @brief  Write one span of the trace as a Chrome trace event, or two for an async one
+ * @param  *file: The trace file
+ * @param  *event: The event
+ * @param  tid: The executor it was recorded on
+ * @param  us_per_tick: To convert its timestamps
+ * @param  async_id: A unique id for an async span
+ * @retval None
+ */
+void write_trace_event(FILE *file, struct trace_event *event, int tid, double us_per_tick,
+                       size_t async_id) {
+    // What the task did when it gave its executor up, by pending_kind
+    static const char *run_ends[] = {"none", "yield", "preempted", "io", "exit", "blocked"};
+    static const char *io_ops[] = {"open", "read", "write", "close"};
 
-    // I_EXEC runs this
-    out = read(fd, buf, size);
+    double ts = (double)(int64_t)(event->start - trace_start_tsc) * us_per_tick;
+    double dur = (double)(int64_t)(event->end - event->start) * us_per_tick;
+    int pid = (int)getpid();
 
-    // Put it back to ready_queue for C_EXEC and give the control to I_EXEC
-    current_context = (ucontext_t *)malloc(sizeof(ucontext_t));
+    switch (event->type) {
+    case TRACE_RUN:
+        fprintf(file,
+                ",\n{\"name\":\"task %lu\",\"cat\":\"run\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"task\":%lu,\"then\":\"%s\"}}",
+                event->id, ts, dur, pid, tid, event->id, run_ends[event->arg]);
+        break;
+    case TRACE_IDLE:
+        fprintf(file,
+                ",\n{\"name\":\"idle\",\"cat\":\"idle\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,"
+                "\"tid\":%d}",
+                ts, dur, pid, tid);
+        break;
+    case TRACE_READY:
+    case TRACE_IO: {
+        // Not spent on an executor, an async span on a track of its own
+        const char *name = event->type == TRACE_READY ? (event->arg ? "created" : "ready") : io_ops[event->arg];
+        const char *cat = event->type == TRACE_READY ? "ready" : "io";
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"b\",\"id\":%zu,\"ts\":%.3f,\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"task\":%lu}}",
+                name, cat, async_id, ts, pid, tid, event->id);
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\",\"id\":%zu,\"ts\":%.3f,\"pid\":%d,"
+                "\"tid\":%d}",
+                name, cat, async_id, ts + dur, pid, tid);
+        break;
+    }
+    }
+}
 
-    current_context->uc_stack.ss_sp = (char *)malloc(THREAD_STACK_SIZE);
-    current_context->uc_stack.ss_size = THREAD_STACK_SIZE;
-    current_context->uc_link = 0;
-    current_context->uc_stack.ss_flags = 0;
+/**
+ * @brief  Write the events of every executor to trace_path as Chrome trace JSON
+ * @note   Once every executor stopped. It opens in chrome://tracing or ui.perfetto.dev: a track per
+ *         executor with the tasks it ran and its idle time, the waits in the ready queues and the
+ *         I/Os as async spans
+ * @retval None
+ */
+void write_trace() {
+    FILE *file = fopen(trace_path, "w");
+    if (file == NULL) {
+        perror("SUT trace");
+        return;
+    }
 
-    parent_context = get_parent_thread(get_thread_id());
+    uint64_t elapsed_ticks = trace_clock() - trace_start_tsc;
+    double elapsed_us = (double)(clock_ns() - trace_start_ns) / 1e3;
+    double us_per_tick = elapsed_us / (double)(elapsed_ticks ? elapsed_ticks : 1);
+    int pid = (int)getpid();
+    size_t async_id = 0;
 
-    temp_entry = queue_new_node(current_context);
-    pthread_mutex_lock(&ready_queue_lock);
-    queue_insert_tail(&ready_queue, temp_entry);
-    pthread_mutex_unlock(&ready_queue_lock);
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"SUT\"}}", pid);
+    for (int i = 0; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        threaddesc *desc = thread_array[i];
+        fprintf(file,
+                ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s %d\"}}",
+                pid, i, is_CEXEC(desc) ? "C_EXEC" : "I_EXEC", is_CEXEC(desc) ? i : i - num_of_CEXEC);
 
-    if (out > 1) {
-        result = "Read Successfully!";
+        size_t first;
+        size_t num = trace_ring_span(&desc->trace, &first);
+        for (size_t j = 0; j < num; j++) {
+            write_trace_event(file, trace_ring_event(&desc->trace, first + j), i, us_per_tick, async_id++);
+        }
     }
+    fprintf(file, "\n]}\n");
 
-    swapcontext(current_context, parent_context);
-
-    return result;
+    fclose(file);
 }
 
 /**
@@ -536,18 +4076,62 @@ char *sut_read(int fd, char *buf, int size) {
 void sut_shutdown() {
     kill_all_threads();
 
+    if (preempt_quantum_us > 0) {
+        sigaction(SIGURG, &old_preempt_action, NULL);
+    }
+
+    // With SUT_STATS the whole run is dumped, once every executor stopped
+    if (is_stats_enabled) {
+        struct sut_stats *stats = sut_stats();
+        sut_stats_print(stats);
+        free(stats);
+    }
+    if (trace_path != NULL) {
+        write_trace();
+        free(trace_path);
+        trace_path = NULL;
+    }
+
     // Clear memory
-    for (int i = 0; i < (num_of_CEXEC + 1); i++) {
-        free_context(thread_array[i]->parent_thread);
+    for (int i = 0; i < (num_of_CEXEC + num_of_IEXEC); i++) {
+        if (thread_array[i]->ring != NULL) {
+            io_ring_destroy(thread_array[i]->ring);
+            free(thread_array[i]->ring);
+        }
+        free(thread_array[i]->fd_busy);
+        if (!is_CEXEC(thread_array[i])) {
+            shared_queue_destroy(&thread_array[i]->wait_queue);
+            // Only now, a late eventcount_notify() must not write to a reused fd
+            if (thread_array[i]->wait_event.event_fd >= 0) {
+                close(thread_array[i]->wait_event.event_fd);
+            }
+        }
+        if (is_pinned() && is_CEXEC(thread_array[i])) {
+            shared_queue_destroy(&thread_array[i]->inbox);
+        }
+        trace_ring_destroy(&thread_array[i]->trace);
+        for (int j = 0; j < SUT_NUM_PRIO; j++) {
+            steal_queue_destroy(&thread_array[i]->local_queue[j]);
+        }
         free(thread_array[i]);
     }
+    free(thread_array);
+    destroy_buffer_pool();
+
+    for (int i = 0; i < SUT_NUM_PRIO; i++) {
+        shared_queue_destroy(&ready_queue[i]);
+    }
+    free(live_tasks);
 
-    struct queue_entry *entry_to_delete = queue_pop_head(&entry_created_queue);
-    while (entry_to_delete != NULL) {
-        free_context(entry_to_delete->data);
-        free(entry_to_delete);
-        entry_to_delete = queue_pop_head(&entry_created_queue);
+    struct queue_entry *slab_to_delete = queue_pop_head(&task_slab_queue);
+    while (slab_to_delete != NULL) {
+        taskslab *slab = (taskslab *)slab_to_delete->data;
+        slab_to_delete = queue_pop_head(&task_slab_queue);
+        munmap(slab->stacks, slab->stacks_size);
+        free(slab);
     }
+    free(free_task_queues);
+    free(executor_cpus);
 
     puts("SUT closed!");
 }
\ No newline at end of file
@@ -1,18 +1,167 @@
 #ifndef __SUT_H__
 #define __SUT_H__
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef void (*sut_task_f)();
 
+typedef void *(*sut_task_arg_f)(void *arg);
+
+// The priorities of sut_create_prio(), the others create SUT_PRIO_NORMAL tasks
+enum sut_prio {
+    SUT_PRIO_HIGH,
+    SUT_PRIO_NORMAL,
+    SUT_PRIO_LOW,
+    SUT_NUM_PRIO,
+};
+
+// The handle of a task, 0 never names one
+typedef unsigned long sut_task_t;
+
+// The token of an asynchronous I/O, for sut_await()
+typedef struct sut_io *sut_io_t;
+
+// A bounded channel between tasks, from sut_chan_create()
+typedef struct sut_chan *sut_chan_t;
+
+// A mutex, condition variable and semaphore that park the waiting task instead of its C_EXEC
+typedef struct sut_mutex *sut_mutex_t;
+typedef struct sut_cond *sut_cond_t;
+typedef struct sut_sem *sut_sem_t;
+
+// What sut_read_timeout() and sut_write_timeout() return when the time is up
+#define SUT_TIMEDOUT (-2)
+
+// A result slot owned by the caller, holding what the task returned once it exited
+typedef struct sut_future {
+    sut_task_t task;
+    void *result;
+} sut_future;
+
+// How an executor with nothing to run waits for work
+#define SUT_IDLE_PARK 0 // It sleeps at once
+#define SUT_IDLE_SPIN 1 // It polls for idle_spin_us first, yielding its CPU in between, then sleeps
+
+// The settings of sut_init_ex(). sut_config_init() fills in what sut_init() uses, from the SUT_*
+// environment variables where they are set
+struct sut_config {
+    int num_of_cexec;       // C_EXECs, SUT_NUM_CEXEC or one per online core
+    int num_of_iexec;       // I_EXECs, SUT_NUM_IEXEC or 1
+    size_t stack_size;      // The default stack of a task in bytes, SUT_STACK_SIZE or 64KB
+    size_t queue_capacity;  // The lock-free ring of every ready and wait queue, SUT_QUEUE_CAPACITY or 4096
+    int idle_policy;        // SUT_IDLE_PARK, or SUT_IDLE_SPIN with SUT_IDLE=spin
+    long idle_spin_us;      // How long SUT_IDLE_SPIN polls, SUT_IDLE_SPIN_US or 50
+    bool use_io_uring;      // false with SUT_IO_URING=0, the I/Os then use blocking system calls
+    long quantum_us;        // The time slice, SUT_QUANTUM_US or 0 for cooperative scheduling
+    bool is_stats_enabled;  // Record the histograms and print the stats at shutdown, SUT_STATS
+    size_t buf_size;        // The size of a leased buffer, SUT_BUF_SIZE or 64KB
+    int num_of_bufs;        // The number of buffers to lease, SUT_NUM_BUFS or 64
+    const char *cpus;       // The CPUs to pin the executors to, SUT_CPUS or NULL not to pin them
+    const char *trace_path; // Where sut_shutdown() writes a Chrome trace, SUT_TRACE or NULL for none
+    size_t trace_events;    // The last events each executor keeps for it, SUT_TRACE_EVENTS or 65536
+};
+
+// Counters of the executors parking while they have nothing to run
+struct sut_idle_stats {
+    unsigned long parks;
+    unsigned long wakeups;          // Woken by a notification
+    unsigned long spurious_wakeups; // Woken without a notification before the deadline
+    unsigned long timeouts;         // Woken by the deadline, e.g. for a sleeping task
+};
+
+// A log-linear histogram of nanoseconds, every power of two is split in 8 buckets
+#define SUT_HISTOGRAM_BUCKETS 496
+
+struct sut_histogram {
+    unsigned long count;
+    unsigned long sum;
+    unsigned long max;
+    unsigned long buckets[SUT_HISTOGRAM_BUCKETS];
+};
+
+// The counters of one executor
+struct sut_executor_stats {
+    bool is_io;                     // The I_EXEC, otherwise a C_EXEC
+    unsigned long switches;         // Tasks run
+    unsigned long preemptions;
+    unsigned long steals;           // Tasks taken from another C_EXEC
+    unsigned long ios;              // I/Os completed
+    unsigned long parks;
+    unsigned long wakeups;
+    unsigned long spurious_wakeups;
+    unsigned long timeouts;
+    long queue_depth;               // Its local_queue for a C_EXEC, the I/Os in flight for the I_EXEC
+};
+
+// A snapshot of the scheduler. The histograms are only recorded with SUT_STATS=1
+struct sut_stats {
+    long ready_queue_depth;
+    long wait_queue_depth;
+    long live_tasks;
+    struct sut_histogram queue_wait;    // From ready to running
+    struct sut_histogram run_slice;     // From running to switched out
+    struct sut_histogram io_turnaround; // From asking for an I/O to its completion
+    int num_of_executors;
+    struct sut_executor_stats executors[]; // The C_EXECs, then the I_EXEC
+};
+
 void sut_init();
-bool sut_create(sut_task_f fn);
+void sut_config_init(struct sut_config *config);
+void sut_init_ex(const struct sut_config *config);
+sut_task_t sut_create(sut_task_f fn);
+sut_task_t sut_create_arg(sut_task_arg_f fn, void *arg);
+sut_task_t sut_create_prio(sut_task_arg_f fn, void *arg, int prio);
+sut_task_t sut_create_stack(sut_task_arg_f fn, void *arg, size_t stack_size);
+sut_task_t sut_create_future(sut_future *future, sut_task_arg_f fn, void *arg);
+size_t sut_create_batch(const sut_task_arg_f *fns, void *const *args, size_t n, sut_task_t *tasks);
+bool sut_join(sut_task_t task);
+void *sut_future_get(sut_future *future);
 void sut_yield();
+void sut_sleep(unsigned long ns);
 void sut_exit();
 int sut_open(char *dest);
+int sut_open_direct(char *dest);
 void sut_write(int fd, char *buf, int size);
 void sut_close(int fd);
 char *sut_read(int fd, char *buf, int size);
+int sut_read_timeout(int fd, char *buf, int size, unsigned long timeout_ns);
+int sut_write_timeout(int fd, char *buf, int size, unsigned long timeout_ns);
+sut_io_t sut_read_async(int fd, char *buf, int size);
+sut_io_t sut_write_async(int fd, char *buf, int size);
+int sut_await(sut_io_t io);
+char *sut_buf_lease();
+void sut_buf_release(char *buf);
+int sut_buf_size();
+sut_chan_t sut_chan_create(size_t elem_size, size_t capacity);
+bool sut_chan_send(sut_chan_t chan, const void *elem);
+bool sut_chan_recv(sut_chan_t chan, void *elem);
+bool sut_chan_try_send(sut_chan_t chan, const void *elem);
+bool sut_chan_try_recv(sut_chan_t chan, void *elem);
+void sut_chan_close(sut_chan_t chan);
+void sut_chan_destroy(sut_chan_t chan);
+sut_mutex_t sut_mutex_create();
+void sut_mutex_lock(sut_mutex_t mutex);
+bool sut_mutex_trylock(sut_mutex_t mutex);
+void sut_mutex_unlock(sut_mutex_t mutex);
+void sut_mutex_destroy(sut_mutex_t mutex);
+sut_cond_t sut_cond_create();
+void sut_cond_wait(sut_cond_t cond, sut_mutex_t mutex);
+void sut_cond_signal(sut_cond_t cond);
+void sut_cond_broadcast(sut_cond_t cond);
+void sut_cond_destroy(sut_cond_t cond);
+sut_sem_t sut_sem_create(unsigned int value);
+void sut_sem_wait(sut_sem_t sem);
+bool sut_sem_trywait(sut_sem_t sem);
+void sut_sem_post(sut_sem_t sem);
+void sut_sem_destroy(sut_sem_t sem);
 void sut_shutdown();
+void sut_get_idle_stats(struct sut_idle_stats *stats);
+const char *sut_context_backend();
+struct sut_stats *sut_stats();
+unsigned long sut_histogram_percentile(const struct sut_histogram *histogram, double percentile);
+void sut_stats_print(const struct sut_stats *stats);
+void sut_preempt_disable();
+void sut_preempt_enable();
 
 
 #endif
@@ -0,0 +1,60 @@
+#include "sut.h"
+#include <stdio.h>
+
+#define NUM_OF_WORKERS 4
+#define NUM_OF_ROUNDS 100
+
+sut_mutex_t lock;
+sut_cond_t all_done;
+sut_sem_t slots;
+int counter;
+int num_of_workers_done;
+
+void worker() {
+    int i;
+    for (i = 0; i < NUM_OF_ROUNDS; i++) {
+        // At most two workers are between the wait and the post
+        sut_sem_wait(slots);
+        sut_mutex_lock(lock);
+        counter++;
+        // Holding the mutex across a yield only parks the other workers
+        if (i % 10 == 0) {
+            sut_yield();
+        }
+        sut_mutex_unlock(lock);
+        sut_sem_post(slots);
+    }
+
+    sut_mutex_lock(lock);
+    num_of_workers_done++;
+    sut_cond_signal(all_done);
+    sut_mutex_unlock(lock);
+    sut_exit();
+}
+
+void waiter() {
+    sut_mutex_lock(lock);
+    while (num_of_workers_done < NUM_OF_WORKERS) {
+        sut_cond_wait(all_done, lock);
+    }
+    printf("All %d workers done, counter = %d\n", num_of_workers_done, counter);
+    sut_mutex_unlock(lock);
+    sut_exit();
+}
+
+int main() {
+    sut_init();
+    lock = sut_mutex_create();
+    all_done = sut_cond_create();
+    slots = sut_sem_create(2);
+
+    sut_create(waiter);
+    for (int i = 0; i < NUM_OF_WORKERS; i++) {
+        sut_create(worker);
+    }
+    sut_shutdown();
+
+    sut_mutex_destroy(lock);
+    sut_cond_destroy(all_done);
+    sut_sem_destroy(slots);
+}
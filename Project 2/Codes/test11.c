@@ -0,0 +1,61 @@
+#include "sut.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MS 1000000UL
+
+void *sleeper(void *arg) {
+    long rank = (long)arg;
+
+    sut_sleep(rank * 20 * MS);
+    printf("Sleeper %ld woke up after %ld ms\n", rank, rank * 20);
+    return NULL;
+}
+
+void reader() {
+    char buf[64];
+    memset(buf, 0, sizeof(buf));
+
+    // Nothing is written to the FIFO yet, the read gives up
+    int fd = sut_open("./test11.fifo");
+    if (fd < 0) {
+        printf("Error: sut_open() failed\n");
+        sut_exit();
+    }
+    if (sut_read_timeout(fd, buf, sizeof(buf) - 1, 10 * MS) == SUT_TIMEDOUT) {
+        printf("Read timed out\n");
+    }
+
+    sut_write(fd, "ping\n", 5);
+    int size = sut_read_timeout(fd, buf, sizeof(buf) - 1, 10 * MS);
+    printf("Read %d bytes: %s", size, buf);
+    sut_close(fd);
+    sut_exit();
+}
+
+int main() {
+    unlink("./test11.fifo");
+    mkfifo("./test11.fifo", 0666);
+
+    sut_init();
+    // The sleepers start in the order 3, 1, 2 and wake up in the order 1, 2, 3
+    sut_task_t sleepers[3];
+    sleepers[0] = sut_create_arg(sleeper, (void *)3);
+    sleepers[1] = sut_create_arg(sleeper, (void *)1);
+    sleepers[2] = sut_create_arg(sleeper, (void *)2);
+    for (int i = 0; i < 3; i++) {
+        sut_join(sleepers[i]);
+    }
+
+    // The executors parked until the next timer, those wakeups are timeouts and not spurious
+    struct sut_idle_stats idle;
+    sut_get_idle_stats(&idle);
+    printf("Sleeping caused no spurious wakeups: %s\n", idle.spurious_wakeups <= 2 ? "yes" : "no");
+
+    sut_create(reader);
+    sut_shutdown();
+
+    unlink("./test11.fifo");
+}
@@ -0,0 +1,52 @@
+#include "sut.h"
+#include <stdio.h>
+
+#define NUM_OF_TASKS 8
+
+long squares[2][NUM_OF_TASKS];
+sut_task_t workers[2][NUM_OF_TASKS];
+
+void *square(void *arg) {
+    long i = (long)arg;
+    squares[i / NUM_OF_TASKS][i % NUM_OF_TASKS] = (i % NUM_OF_TASKS) * (i % NUM_OF_TASKS);
+    return NULL;
+}
+
+void *collector(void *arg) {
+    long round = (long)arg;
+    long sum = 0;
+    for (int i = 0; i < NUM_OF_TASKS; i++) {
+        sut_join(workers[round][i]);
+        sum += squares[round][i];
+    }
+    printf("Round %ld: %d tasks, sum of squares %ld\n", round, NUM_OF_TASKS, sum);
+    return NULL;
+}
+
+void spawner() {
+    // A batch created from a task goes to the local queue of its C_EXEC
+    sut_task_arg_f fns[NUM_OF_TASKS];
+    void *args[NUM_OF_TASKS];
+    for (long i = 0; i < NUM_OF_TASKS; i++) {
+        fns[i] = square;
+        args[i] = (void *)(NUM_OF_TASKS + i);
+    }
+    sut_create_batch(fns, args, NUM_OF_TASKS, workers[1]);
+    sut_join(sut_create_arg(collector, (void *)1));
+    sut_exit();
+}
+
+int main() {
+    sut_task_arg_f fns[NUM_OF_TASKS];
+    void *args[NUM_OF_TASKS];
+    for (long i = 0; i < NUM_OF_TASKS; i++) {
+        fns[i] = square;
+        args[i] = (void *)i;
+    }
+
+    sut_init();
+    sut_create_batch(fns, args, NUM_OF_TASKS, workers[0]);
+    sut_join(sut_create_arg(collector, (void *)0));
+    sut_create(spawner);
+    sut_shutdown();
+}
@@ -0,0 +1,49 @@
+#include "sut.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define NUM_OF_TASKS 32
+
+long results[NUM_OF_TASKS];
+
+void *counter(void *arg) {
+    long n = (long)(intptr_t)arg;
+    long sum = 0;
+    for (long i = 1; i <= n; i++) {
+        sum += i;
+        if (i % 10 == 0) {
+            sut_yield();
+        }
+    }
+    results[n - 1] = sum;
+    return NULL;
+}
+
+int main() {
+    // Everything sut_init() would use, with a few settings of our own
+    struct sut_config config;
+    sut_config_init(&config);
+    config.num_of_cexec = 2;
+    config.num_of_iexec = 1;
+    config.stack_size = 32 * 1024;
+    config.queue_capacity = 4; // The tasks from main() overflow it
+    config.idle_policy = SUT_IDLE_SPIN;
+    config.idle_spin_us = 100;
+
+    sut_init_ex(&config);
+    sut_task_t tasks[NUM_OF_TASKS];
+    for (long i = 0; i < NUM_OF_TASKS; i++) {
+        tasks[i] = sut_create_arg(counter, (void *)(intptr_t)(i + 1));
+    }
+    for (int i = 0; i < NUM_OF_TASKS; i++) {
+        sut_join(tasks[i]);
+    }
+
+    long total = 0;
+    for (int i = 0; i < NUM_OF_TASKS; i++) {
+        total += results[i];
+    }
+    printf("%d tasks on 2 C_EXECs, total %ld, expected %ld\n", NUM_OF_TASKS, total,
+           (long)NUM_OF_TASKS * (NUM_OF_TASKS + 1) * (NUM_OF_TASKS + 2) / 6);
+    sut_shutdown();
+}
@@ -0,0 +1,64 @@
+#include "sut.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define NUM_OF_ROUNDS 1000
+
+sut_sem_t turns[2];
+atomic_bool is_done;
+long background_yields;
+long background_yields_during;
+long posted_at;   // background_yields when the turn was passed
+long num_of_late; // Turns the background task ran in before the partner
+
+void *player(void *arg) {
+    long i = (long)arg;
+    for (int round = 0; round < NUM_OF_ROUNDS; round++) {
+        // The partner woken here runs next on the C_EXEC, ahead of the background task
+        sut_sem_wait(turns[i]);
+        if (round > 0 || i == 1) {
+            num_of_late += background_yields != posted_at;
+        }
+        posted_at = background_yields;
+        sut_sem_post(turns[1 - i]);
+    }
+    if (i == 1) {
+        background_yields_during = background_yields;
+        atomic_store(&is_done, true);
+    }
+    return NULL;
+}
+
+void *background(void *arg) {
+    (void)arg;
+    while (!atomic_load(&is_done)) {
+        background_yields++;
+        sut_yield();
+    }
+    return NULL;
+}
+
+int main() {
+    // One C_EXEC, so the three tasks share it
+    struct sut_config config;
+    sut_config_init(&config);
+    config.num_of_cexec = 1;
+
+    sut_init_ex(&config);
+    turns[0] = sut_sem_create(1);
+    turns[1] = sut_sem_create(0);
+    sut_task_t tasks[3];
+    tasks[0] = sut_create_arg(background, NULL);
+    tasks[1] = sut_create_arg(player, (void *)0);
+    tasks[2] = sut_create_arg(player, (void *)1);
+    for (int i = 0; i < 3; i++) {
+        sut_join(tasks[i]);
+    }
+
+    printf("Passed the turn %d times\n", 2 * NUM_OF_ROUNDS);
+    printf("Partner ran next in most turns: %s\n", num_of_late * 4 < 2 * NUM_OF_ROUNDS ? "yes" : "no");
+    printf("Background task ran meanwhile: %s\n", background_yields_during > 0 ? "yes" : "no");
+    sut_sem_destroy(turns[0]);
+    sut_sem_destroy(turns[1]);
+    sut_shutdown();
+}
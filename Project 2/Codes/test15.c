@@ -0,0 +1,57 @@
+#include "sut.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+// The poster keeps its C_EXEC this long after waking the waiter, unless the waiter starts first
+#define MAX_BUSY_NS 2000000000L
+
+sut_sem_t wakeup;
+atomic_bool has_waiter_started;
+
+long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void *waiter(void *arg) {
+    (void)arg;
+    sut_sem_wait(wakeup);
+    atomic_store(&has_waiter_started, true);
+    return NULL;
+}
+
+void *poster(void *arg) {
+    (void)arg;
+    // Let the waiter block, then keep the C_EXEC until the other one parked again
+    sut_sleep(50000000);
+    long until = now_ns() + 20000000;
+    while (now_ns() < until) {
+    }
+
+    sut_sem_post(wakeup);
+    until = now_ns() + MAX_BUSY_NS;
+    while (!atomic_load(&has_waiter_started) && now_ns() < until) {
+    }
+    printf("Waiter started while the poster kept running: %s\n",
+           atomic_load(&has_waiter_started) ? "yes" : "no");
+    return NULL;
+}
+
+int main() {
+    // Two C_EXECs, the second one is idle when the waiter is woken
+    struct sut_config config;
+    sut_config_init(&config);
+    config.num_of_cexec = 2;
+
+    sut_init_ex(&config);
+    wakeup = sut_sem_create(0);
+    sut_task_t tasks[2];
+    tasks[0] = sut_create_arg(waiter, NULL);
+    tasks[1] = sut_create_arg(poster, NULL);
+    sut_join(tasks[0]);
+    sut_join(tasks[1]);
+    sut_sem_destroy(wakeup);
+    sut_shutdown();
+}
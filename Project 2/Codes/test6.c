@@ -0,0 +1,52 @@
+#include "sut.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define NUM_OF_WORKERS 4
+#define NUM_OF_VALUES 4000
+
+int values[NUM_OF_VALUES];
+
+void *worker(void *arg) {
+    int part = (int)(intptr_t)arg;
+    int begin = part * (NUM_OF_VALUES / NUM_OF_WORKERS);
+    int end = begin + NUM_OF_VALUES / NUM_OF_WORKERS;
+    long sum = 0;
+    for (int i = begin; i < end; i++) {
+        sum += values[i];
+        if (i % 100 == 0) {
+            sut_yield();
+        }
+    }
+    printf("Worker %d done\n", part);
+    return (void *)(intptr_t)sum;
+}
+
+void coordinator() {
+    sut_future workers[NUM_OF_WORKERS];
+    for (int i = 0; i < NUM_OF_WORKERS; i++) {
+        sut_create_future(&workers[i], worker, (void *)(intptr_t)i);
+    }
+
+    long sum = 0;
+    for (int i = 0; i < NUM_OF_WORKERS; i++) {
+        sum += (long)(intptr_t)sut_future_get(&workers[i]);
+    }
+    printf("Sum: %ld, expected: %ld\n", sum, (long)NUM_OF_VALUES * (NUM_OF_VALUES + 1) / 2);
+    sut_exit();
+}
+
+int main() {
+    for (int i = 0; i < NUM_OF_VALUES; i++) {
+        values[i] = i + 1;
+    }
+
+    sut_init();
+    sut_task_t t = sut_create(coordinator);
+    if (t == 0)
+        printf("Error: sut_create(coordinator) failed\n");
+    if (!sut_join(t))
+        printf("Error: sut_join(coordinator) failed\n");
+    printf("Coordinator joined\n");
+    sut_shutdown();
+}
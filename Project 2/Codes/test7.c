@@ -0,0 +1,53 @@
+#include "sut.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NUM_OF_CHUNKS 4
+
+void hello1() {
+    int i, fd;
+    char chunks[NUM_OF_CHUNKS][64];
+    sut_io_t writes[NUM_OF_CHUNKS];
+
+    fd = sut_open("./test7.txt");
+    if (fd < 0) {
+        printf("Error: sut_open() failed\n");
+        sut_exit();
+    }
+
+    // All the writes are in flight together, and still land in order
+    for (i = 0; i < NUM_OF_CHUNKS; i++) {
+        sprintf(chunks[i], "Chunk %d from SUT-One\n", i);
+        writes[i] = sut_write_async(fd, chunks[i], strlen(chunks[i]));
+    }
+    printf("Writes started\n");
+    for (i = 0; i < NUM_OF_CHUNKS; i++) {
+        printf("Write %d: %d bytes\n", i, sut_await(writes[i]));
+    }
+    sut_close(fd);
+
+    char buf[256];
+    memset(buf, 0, sizeof(buf));
+    fd = sut_open("./test7.txt");
+    sut_io_t read = sut_read_async(fd, buf, sizeof(buf) - 1);
+    int size = sut_await(read);
+    printf("Read %d bytes:\n%s", size, buf);
+    sut_close(fd);
+    sut_exit();
+}
+
+void hello2() {
+    int i;
+    for (i = 0; i < 10; i++) {
+        printf("Hello world!, this is SUT-Two \n");
+        sut_yield();
+    }
+    sut_exit();
+}
+
+int main() {
+    sut_init();
+    sut_create(hello1);
+    sut_create(hello2);
+    sut_shutdown();
+}
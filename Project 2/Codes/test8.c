@@ -0,0 +1,52 @@
+#include "sut.h"
+#include <stdio.h>
+#include <string.h>
+
+void hello1() {
+    int i, fd;
+
+    // The I/Os go straight from and into buffers of the pool
+    char *out = sut_buf_lease();
+    char *in = sut_buf_lease();
+    if (out == NULL || in == NULL) {
+        printf("Error: sut_buf_lease() failed\n");
+        sut_exit();
+    }
+
+    fd = sut_open("./test8.txt");
+    if (fd < 0) {
+        printf("Error: sut_open() failed\n");
+        sut_exit();
+    }
+    for (i = 0; i < 3; i++) {
+        sprintf(out, "Line %d from SUT-One\n", i);
+        sut_write(fd, out, strlen(out));
+    }
+    sut_close(fd);
+
+    fd = sut_open("./test8.txt");
+    int size = sut_await(sut_read_async(fd, in, sut_buf_size() - 1));
+    in[size < 0 ? 0 : size] = '\0';
+    printf("Read %d bytes:\n%s", size, in);
+    sut_close(fd);
+
+    sut_buf_release(out);
+    sut_buf_release(in);
+    sut_exit();
+}
+
+void hello2() {
+    int i;
+    for (i = 0; i < 10; i++) {
+        printf("Hello world!, this is SUT-Two \n");
+        sut_yield();
+    }
+    sut_exit();
+}
+
+int main() {
+    sut_init();
+    sut_create(hello1);
+    sut_create(hello2);
+    sut_shutdown();
+}
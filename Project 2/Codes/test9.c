@@ -0,0 +1,54 @@
+#include "sut.h"
+#include <stdio.h>
+
+#define NUM_OF_VALUES 100
+
+sut_chan_t numbers;
+sut_chan_t squares;
+
+void producer() {
+    // The channel holds 4 values, the producer parks until the squarer catches up
+    for (int i = 1; i <= NUM_OF_VALUES; i++) {
+        sut_chan_send(numbers, &i);
+    }
+    sut_chan_close(numbers);
+    printf("Producer sent %d values\n", NUM_OF_VALUES);
+    sut_exit();
+}
+
+void squarer() {
+    int value;
+    while (sut_chan_recv(numbers, &value)) {
+        long square = (long)value * value;
+        sut_chan_send(squares, &square);
+    }
+    sut_chan_close(squares);
+    printf("Squarer done\n");
+    sut_exit();
+}
+
+void printer() {
+    long square, sum = 0;
+    int count = 0;
+    while (sut_chan_recv(squares, &square)) {
+        if (count < 5) {
+            printf("Received %ld\n", square);
+        }
+        sum += square;
+        count++;
+    }
+    printf("Printer received %d values, sum %ld\n", count, sum);
+    sut_exit();
+}
+
+int main() {
+    sut_init();
+    numbers = sut_chan_create(sizeof(int), 4);
+    squares = sut_chan_create(sizeof(long), 4);
+    sut_create(printer);
+    sut_create(squarer);
+    sut_create(producer);
+    sut_shutdown();
+    sut_chan_destroy(numbers);
+    sut_chan_destroy(squares);
+}
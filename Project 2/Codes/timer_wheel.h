@@ -0,0 +1,183 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A hierarchical timer wheel, in the style of the classic Linux one, owned by a single thread.
+ * Time is counted in ticks. Level 0 has a slot per tick for the next 64 ticks, and every level
+ * above has slots 64 times as wide. When the ticks of a level wrap, the next slot of the level
+ * above is cascaded down, so adding and firing a timer are O(1). The timers are intrusive, so
+ * nothing is allocated per timer.
+ */
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+// Timers further away wait in the last slot of the top level, and are placed again when it cascades
+#define TIMER_WHEEL_RANGE ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+struct timer_node {
+    uint64_t expiry; // The tick it fires at
+    void *data;
+    struct timer_node *next;
+};
+
+struct timer_wheel {
+    uint64_t tick; // Every timer up to this tick has fired
+    long num_of_timers;
+    long level_counts[TIMER_WHEEL_LEVELS];
+    struct timer_node *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+void timer_wheel_init(struct timer_wheel *w, uint64_t tick) {
+    w->tick = tick;
+    w->num_of_timers = 0;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        w->level_counts[level] = 0;
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            w->slots[level][slot] = NULL;
+        }
+    }
+}
+
+/**
+ * @brief  Put a timer in the slot for its expiry
+ * @note   Its expiry must be after the current tick
+ */
+void timer_wheel_place(struct timer_wheel *w, struct timer_node *timer) {
+    uint64_t delta = timer->expiry - w->tick;
+    uint64_t expiry = delta < TIMER_WHEEL_RANGE ? timer->expiry : w->tick + TIMER_WHEEL_RANGE - 1;
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    struct timer_node **slot = &w->slots[level][(expiry >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+    timer->next = *slot;
+    *slot = timer;
+    w->level_counts[level]++;
+}
+
+/**
+ * @brief  Add a timer
+ * @param  *w: The timer wheel
+ * @param  *timer: The timer, its expiry and data set
+ * @retval false if it expired already, then it was not added
+ */
+bool timer_wheel_add(struct timer_wheel *w, struct timer_node *timer) {
+    if (timer->expiry <= w->tick) {
+        return false;
+    }
+
+    timer_wheel_place(w, timer);
+    w->num_of_timers++;
+    return true;
+}
+
+/**
+ * @brief  Move the timers of a slot of a higher level down to where they belong now
+ */
+void timer_wheel_cascade(struct timer_wheel *w, int level, int index) {
+    struct timer_node *timer = w->slots[level][index];
+    w->slots[level][index] = NULL;
+
+    while (timer != NULL) {
+        struct timer_node *next = timer->next;
+        w->level_counts[level]--;
+        timer_wheel_place(w, timer);
+        timer = next;
+    }
+}
+
+/**
+ * @brief  Advance the wheel to a tick, and fire the timers up to it
+ * @note   fire is called once per timer, which may be added again from there
+ * @param  *w: The timer wheel
+ * @param  tick: The current tick
+ * @param  fire: Called with each expired timer
+ * @param  *arg: The argument of fire
+ * @retval The number of timers fired
+ */
+long timer_wheel_advance(struct timer_wheel *w, uint64_t tick, void (*fire)(struct timer_node *, void *),
+                         void *arg) {
+    long num_of_fired = 0;
+
+    while (w->tick < tick) {
+        if (w->num_of_timers == 0) {
+            w->tick = tick;
+            break;
+        }
+
+        // While the lower levels are empty nothing happens until the next cascade of the lowest
+        // level with a timer
+        int lowest = 0;
+        while (w->level_counts[lowest] == 0) {
+            lowest++;
+        }
+        if (lowest > 0) {
+            uint64_t boundary = ((w->tick >> (TIMER_WHEEL_BITS * lowest)) + 1) << (TIMER_WHEEL_BITS * lowest);
+            w->tick = boundary - 1 < tick ? boundary - 1 : tick;
+            if (w->tick == tick) {
+                break;
+            }
+        }
+
+        w->tick++;
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((w->tick & (((uint64_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            timer_wheel_cascade(w, level, (w->tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+        }
+
+        struct timer_node **slot = &w->slots[0][w->tick & TIMER_WHEEL_MASK];
+        struct timer_node *timer = *slot;
+        *slot = NULL;
+        while (timer != NULL) {
+            struct timer_node *next = timer->next;
+            w->level_counts[0]--;
+            w->num_of_timers--;
+            num_of_fired++;
+            fire(timer, arg);
+            timer = next;
+        }
+    }
+
+    return num_of_fired;
+}
+
+/**
+ * @brief  The first tick something may happen at, a timer firing or a cascade
+ * @retval The tick, UINT64_MAX without timers
+ */
+uint64_t timer_wheel_next_tick(struct timer_wheel *w) {
+    if (w->num_of_timers == 0) {
+        return UINT64_MAX;
+    }
+
+    // The next cascade of the lowest level above 0 with a timer
+    uint64_t next = UINT64_MAX;
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        if (w->level_counts[level] > 0) {
+            next = ((w->tick >> (TIMER_WHEEL_BITS * level)) + 1) << (TIMER_WHEEL_BITS * level);
+            break;
+        }
+    }
+
+    if (w->level_counts[0] > 0) {
+        for (uint64_t tick = w->tick + 1; tick <= w->tick + TIMER_WHEEL_SLOTS && tick < next; tick++) {
+            if (w->slots[0][tick & TIMER_WHEEL_MASK] != NULL) {
+                return tick;
+            }
+        }
+    }
+
+    return next;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * A ring of scheduling events per executor, written out as Chrome trace JSON. Only its owner thread
+ * records into a ring, and once it is full the oldest events are overwritten. An event is a span with
+ * its start and end, recording it costs a few stores. The timestamps are raw TSC reads on x86-64 and
+ * are converted to microseconds on export, against two reference points taken with the clock.
+ */
+
+enum trace_type {
+    TRACE_RUN,   // A task ran on the executor, arg is what it did next
+    TRACE_READY, // A task waited in the ready queues, arg is 1 when it was just created
+    TRACE_IDLE,  // The executor parked with nothing to run
+    TRACE_IO,    // An I/O of a task, from asked to completed, arg is the operation
+};
+
+struct trace_event {
+    uint64_t start;
+    uint64_t end;
+    unsigned long id; // The task, 0 for none
+    int type;
+    int arg;
+};
+
+struct trace_ring {
+    struct trace_event *events;
+    size_t mask;
+    size_t num_of_events; // Recorded so far, the ring holds the last mask + 1 of them
+};
+
+/**
+ * @brief  The current timestamp, TSC ticks on x86-64 and nanoseconds elsewhere
+ */
+uint64_t trace_clock() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief  Allocate the events of a ring
+ * @note   The capacity is rounded up to a power of two
+ * @retval Whether they could be allocated
+ */
+bool trace_ring_init(struct trace_ring *r, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    r->events = (struct trace_event *)malloc(size * sizeof(struct trace_event));
+    r->mask = size - 1;
+    r->num_of_events = 0;
+    return r->events != NULL;
+}
+
+void trace_ring_destroy(struct trace_ring *r) { free(r->events); }
+
+/**
+ * @brief  Record an event
+ * @note   Owner thread only
+ */
+void trace_ring_record(struct trace_ring *r, int type, uint64_t start, uint64_t end, unsigned long id,
+                       int arg) {
+    struct trace_event *event = &r->events[r->num_of_events & r->mask];
+    event->start = start;
+    event->end = end;
+    event->id = id;
+    event->type = type;
+    event->arg = arg;
+    r->num_of_events++;
+}
+
+/**
+ * @brief  The events still in the ring, oldest first
+ * @param  *r: The ring
+ * @param  *first: Set to the index of the oldest event, to pass to trace_ring_event()
+ * @retval The number of events
+ */
+size_t trace_ring_span(struct trace_ring *r, size_t *first) {
+    size_t num = r->num_of_events > r->mask + 1 ? r->mask + 1 : r->num_of_events;
+    *first = r->num_of_events - num;
+    return num;
+}
+
+struct trace_event *trace_ring_event(struct trace_ring *r, size_t index) { return &r->events[index & r->mask]; }
+
+#endif